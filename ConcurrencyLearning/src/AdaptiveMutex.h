@@ -0,0 +1,108 @@
+#ifndef ADAPTIVEMUTEX_H
+#define ADAPTIVEMUTEX_H
+
+#include "SpinLockMutex.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <algorithm>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// spin-then-park mutex, the lock word has three states:
+//   UNLOCKED, LOCKED (no waiters), CONTENDED (maybe sleeping waiters)
+// only an unlock from CONTENDED calls into the kernel, so an uncontended
+// lock/unlock pair is one CAS and one fetch_sub.
+// a waiter first spins for a self calibrating number of rounds (glibc
+// adaptive mutex style: the estimate follows the spins the last
+// acquisitions needed, capped by max_spins) and then parks on a futex.
+// satisfies Lockable, so it works with lock_guard, unique_lock and
+// condition_variable_any. non linux systems park with yield instead.
+class AdaptiveMutex {
+public:
+	explicit AdaptiveMutex(int max_spins_ = DEFAULT_MAX_SPINS):
+	state(UNLOCKED), spin_estimate(0), max_spins(max_spins_) {
+
+	}
+
+	AdaptiveMutex(const AdaptiveMutex&) = delete;
+	AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+	void lock() {
+		std::uint32_t c = UNLOCKED;
+		if (state.compare_exchange_strong(c, LOCKED, std::memory_order_acquire, std::memory_order_relaxed)) {
+			return;
+		}
+
+		int estimate = spin_estimate.load(std::memory_order_relaxed);
+		int limit = std::min(max_spins, estimate * 2 + 10);
+		for (int spins = 0; spins < limit; spins++) {
+			if (state.load(std::memory_order_relaxed) == UNLOCKED) {
+				c = UNLOCKED;
+				if (state.compare_exchange_strong(c, LOCKED, std::memory_order_acquire, std::memory_order_relaxed)) {
+					spin_estimate.store(estimate + (spins - estimate) / 8, std::memory_order_relaxed);
+					return;
+				}
+			}
+			cpu_relax();
+		}
+		spin_estimate.store(estimate + (limit - estimate) / 8, std::memory_order_relaxed);
+
+		// park, whoever takes the lock from here on leaves it CONTENDED
+		// so that its unlock wakes the next sleeper
+		c = state.exchange(CONTENDED, std::memory_order_acquire);
+		while (c != UNLOCKED) {
+			wait(CONTENDED);
+			c = state.exchange(CONTENDED, std::memory_order_acquire);
+		}
+	}
+
+	bool try_lock() {
+		std::uint32_t c = UNLOCKED;
+		return state.compare_exchange_strong(c, LOCKED, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock() {
+		if (state.fetch_sub(1, std::memory_order_release) != LOCKED) {
+			state.store(UNLOCKED, std::memory_order_release);
+			wake_one();
+		}
+	}
+
+private:
+	static constexpr std::uint32_t UNLOCKED = 0;
+	static constexpr std::uint32_t LOCKED = 1;
+	static constexpr std::uint32_t CONTENDED = 2;
+	static constexpr int DEFAULT_MAX_SPINS = 100;
+
+	void wait(std::uint32_t expect) {
+#if defined(__linux__)
+		// returns at once if the word is no longer expect
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state),
+			FUTEX_WAIT_PRIVATE, expect, nullptr, nullptr, 0);
+#else
+		if (state.load(std::memory_order_relaxed) == expect) {
+			std::this_thread::yield();
+		}
+#endif
+	}
+
+	void wake_one() {
+#if defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state),
+			FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+	}
+
+	std::atomic<std::uint32_t> state;
+	std::atomic<int> spin_estimate;
+	const int max_spins;
+
+	static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+		"futex needs a plain 32 bit word");
+};
+
+#endif // !ADAPTIVEMUTEX_H
@@ -0,0 +1,85 @@
+#ifndef BLOCKEDRANGE_H
+#define BLOCKEDRANGE_H
+
+#include "ThreadPool.h"
+#include "Partitioner.h"
+#include <algorithm>
+#include <cstddef>
+
+// rows [row_begin, row_end) x columns [col_begin, col_end)
+struct Range2d {
+    std::size_t rows() const {
+        return row_end - row_begin;
+    }
+
+    std::size_t cols() const {
+        return col_end - col_begin;
+    }
+
+    std::size_t row_begin;
+    std::size_t row_end;
+    std::size_t col_begin;
+    std::size_t col_end;
+};
+
+// a rows x cols grid cut into tiles of tile_rows x tile_cols, the tiles at
+// the bottom and right edges may be smaller. tiles are numbered row by row.
+class BlockedRange2d {
+public:
+    BlockedRange2d(std::size_t rows_, std::size_t cols_, std::size_t tile_rows_, std::size_t tile_cols_):
+    num_rows(rows_), num_cols(cols_),
+    tile_rows(std::max<std::size_t>(1, tile_rows_)), tile_cols(std::max<std::size_t>(1, tile_cols_)) {
+
+    }
+
+    // square tiles
+    BlockedRange2d(std::size_t rows_, std::size_t cols_, std::size_t tile):
+    BlockedRange2d(rows_, cols_, tile, tile) {
+
+    }
+
+    std::size_t rows() const {
+        return num_rows;
+    }
+
+    std::size_t cols() const {
+        return num_cols;
+    }
+
+    std::size_t tiles_per_row() const {
+        return (num_cols + tile_cols - 1) / tile_cols;
+    }
+
+    std::size_t num_tiles() const {
+        return (num_rows + tile_rows - 1) / tile_rows * tiles_per_row();
+    }
+
+    Range2d tile(std::size_t index) const {
+        std::size_t row = index / tiles_per_row() * tile_rows;
+        std::size_t col = index % tiles_per_row() * tile_cols;
+        return Range2d{row, std::min(row + tile_rows, num_rows), col, std::min(col + tile_cols, num_cols)};
+    }
+
+private:
+    std::size_t num_rows;
+    std::size_t num_cols;
+    std::size_t tile_rows;
+    std::size_t tile_cols;
+};
+
+// body(tile) once per tile of the range. the body gets a whole tile, so
+// its inner loop runs over contiguous columns and can be vectorized, and
+// the tile size keeps its working set within a cache level. the
+// partitioner groups tiles into chunks, AffinityPartitioner hands
+// repeated sweeps the tiles each thread had before.
+template<typename Body, typename Partitioner = AutoPartitioner>
+void parallel_for(const BlockedRange2d& range, Body body, const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    parallel_for_range(range.num_tiles(), [&range, &body](std::size_t begin, std::size_t end) {
+        for(; begin < end; begin++) {
+            body(range.tile(begin));
+        }
+    }, partitioner, pool);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef CACHELINE_H
+#define CACHELINE_H
+
+#include <cstddef>
+
+// std::hardware_destructive_interference_size is not reliable across
+// compilers yet, 64 bytes matches x86 and most arm cores
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+// pads a value to its own cache line so neighbours in an array
+// do not falsely share it
+template<typename T>
+struct alignas(CACHE_LINE_SIZE) CacheAligned {
+    T value;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef EPOCHRECLAMATION_H
+#define EPOCHRECLAMATION_H
+
+#include "CacheLine.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// epoch based reclamation for lock-free structures.
+// readers pin the current global epoch with an EpochGuard while they hold
+// raw pointers. a node retired in epoch e is only freed once the global
+// epoch reached e + 2, at that point every thread that could still see it
+// has left its critical section.
+// retire() requires the node to be unreachable for new readers already.
+class EpochManager {
+private:
+    struct RetiredNode {
+        void* ptr;
+        void (*deleter)(void*);
+        std::uint64_t epoch;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) ThreadRecord {
+        ThreadRecord():
+        epoch(0), active(false), in_use(true), next(nullptr), nesting(0) {
+
+        }
+
+        std::atomic<std::uint64_t> epoch;
+        std::atomic<bool> active;
+        std::atomic<bool> in_use;
+        ThreadRecord* next;
+        // only touched by the owning thread
+        int nesting;
+        std::vector<RetiredNode> retired;
+    };
+
+    // releases the record when its thread exits, leftover retired nodes
+    // stay in the record and are freed by the next owner
+    struct ThreadHandle {
+        ThreadHandle():
+        record(EpochManager::instance().acquire_record()) {
+
+        }
+
+        ~ThreadHandle() {
+            record->in_use.store(false, std::memory_order_release);
+        }
+
+        ThreadRecord* record;
+    };
+
+public:
+    static EpochManager& instance() {
+        static EpochManager manager;
+        return manager;
+    }
+
+    ~EpochManager() {
+        // static destruction, no more readers
+        ThreadRecord* record = records.load();
+        while (record) {
+            for (RetiredNode& node : record->retired) {
+                node.deleter(node.ptr);
+            }
+            ThreadRecord* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+    void enter() {
+        ThreadRecord* record = local_record();
+        if (record->nesting++ == 0) {
+            record->active.store(true, std::memory_order_seq_cst);
+            record->epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+    }
+
+    void exit() {
+        ThreadRecord* record = local_record();
+        if (--record->nesting == 0) {
+            record->active.store(false, std::memory_order_release);
+        }
+    }
+
+    template<typename T>
+    void retire(T* ptr) {
+        ThreadRecord* record = local_record();
+        record->retired.push_back(RetiredNode{
+            ptr,
+            [](void* p) { delete static_cast<T*>(p); },
+            global_epoch.load(std::memory_order_seq_cst)
+        });
+        if (record->retired.size() >= RECLAIM_THRESHOLD) {
+            try_advance();
+            reclaim(record);
+        }
+    }
+
+    // number of nodes retired by this thread and not freed yet
+    std::size_t pending() {
+        return local_record()->retired.size();
+    }
+
+    // advance as far as possible and free what became safe, for tests
+    // and for quiescent points of long running threads
+    void collect() {
+        try_advance();
+        try_advance();
+        reclaim(local_record());
+    }
+
+private:
+    EpochManager():
+    global_epoch(0), records(nullptr) {
+
+    }
+
+    ThreadRecord* local_record() {
+        thread_local ThreadHandle handle;
+        return handle.record;
+    }
+
+    ThreadRecord* acquire_record() {
+        for (ThreadRecord* record = records.load(); record; record = record->next) {
+            bool expect = false;
+            if (record->in_use.compare_exchange_strong(expect, true)) {
+                return record;
+            }
+        }
+        ThreadRecord* record = new ThreadRecord;
+        record->next = records.load();
+        while (!records.compare_exchange_weak(record->next, record));
+        return record;
+    }
+
+    bool try_advance() {
+        std::uint64_t epoch = global_epoch.load(std::memory_order_seq_cst);
+        for (ThreadRecord* record = records.load(); record; record = record->next) {
+            if (record->active.load(std::memory_order_seq_cst)
+                && record->epoch.load(std::memory_order_seq_cst) != epoch) {
+                return false;
+            }
+        }
+        return global_epoch.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+    void reclaim(ThreadRecord* record) {
+        std::uint64_t epoch = global_epoch.load(std::memory_order_seq_cst);
+        std::vector<RetiredNode>& retired = record->retired;
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < retired.size(); i++) {
+            if (retired[i].epoch + 2 <= epoch) {
+                retired[i].deleter(retired[i].ptr);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    static constexpr std::size_t RECLAIM_THRESHOLD = 64;
+
+    std::atomic<std::uint64_t> global_epoch;
+    std::atomic<ThreadRecord*> records;
+};
+
+// pins the current epoch for the lifetime of the guard, guards nest
+class EpochGuard {
+public:
+    EpochGuard() {
+        EpochManager::instance().enter();
+    }
+
+    ~EpochGuard() {
+        EpochManager::instance().exit();
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef EXECUTIONPOLICY_H
+#define EXECUTIONPOLICY_H
+
+#include "ParallelAlgorithm.h"
+#include "JoinerThreads.h"
+#include "CacheLine.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// how an algorithm runs, a value chosen at run time, so a workload can
+// switch strategy through configuration instead of code:
+//   auto policy = ExecutionPolicy::from_name(name).value_or(ExecutionPolicy::pool());
+//   parallel_sort(policy, values.begin(), values.end());
+// SEQUENTIAL  the calling thread only
+// VECTORIZED  the calling thread, through the SimdKernels.h kernels where
+//             the element type has them
+// ASYNC       recursive halving: async_for_each on the default pool, and
+//             async_quick_sort over std::async for sorting
+// THREADS     one std::thread per block, started for this call only, and
+//             thread_pool_quick_sort with a pool of its own for sorting
+// POOL        the ThreadPool algorithms of ParallelAlgorithm.h
+// ranges shorter than sequential_threshold() run as SEQUENTIAL whatever
+// the policy, splitting them costs more than it saves.
+class ExecutionPolicy {
+public:
+    enum class Kind {SEQUENTIAL, VECTORIZED, ASYNC, THREADS, POOL};
+
+    static constexpr std::size_t DEFAULT_SEQUENTIAL_THRESHOLD = 2048;
+
+    static ExecutionPolicy sequential() {
+        return ExecutionPolicy(Kind::SEQUENTIAL, nullptr);
+    }
+
+    static ExecutionPolicy vectorized() {
+        return ExecutionPolicy(Kind::VECTORIZED, nullptr);
+    }
+
+    static ExecutionPolicy async() {
+        return ExecutionPolicy(Kind::ASYNC, nullptr);
+    }
+
+    static ExecutionPolicy threads() {
+        return ExecutionPolicy(Kind::THREADS, nullptr);
+    }
+
+    static ExecutionPolicy pool(ThreadPool& thread_pool = ThreadPool::default_pool()) {
+        return ExecutionPolicy(Kind::POOL, &thread_pool);
+    }
+
+    // "sequential", "vectorized", "async", "threads" or "pool" (the
+    // default pool), nothing for any other name
+    static std::optional<ExecutionPolicy> from_name(const std::string& name) {
+        for(Kind kind : {Kind::SEQUENTIAL, Kind::VECTORIZED, Kind::ASYNC, Kind::THREADS, Kind::POOL}) {
+            if(name == kind_name(kind)) {
+                return ExecutionPolicy(kind, kind == Kind::POOL ? &ThreadPool::default_pool() : nullptr);
+            }
+        }
+        return std::nullopt;
+    }
+
+    static const char* kind_name(Kind kind) {
+        switch(kind) {
+        case Kind::SEQUENTIAL:
+            return "sequential";
+        case Kind::VECTORIZED:
+            return "vectorized";
+        case Kind::ASYNC:
+            return "async";
+        case Kind::THREADS:
+            return "threads";
+        default:
+            return "pool";
+        }
+    }
+
+    Kind kind() const {
+        return policy_kind;
+    }
+
+    const char* name() const {
+        return kind_name(policy_kind);
+    }
+
+    // the pool of a POOL policy, nullptr for the others
+    ThreadPool* thread_pool() const {
+        return pool_ptr;
+    }
+
+    std::size_t sequential_threshold() const {
+        return threshold;
+    }
+
+    ExecutionPolicy with_sequential_threshold(std::size_t threshold_) const {
+        ExecutionPolicy policy = *this;
+        policy.threshold = threshold_;
+        return policy;
+    }
+
+    // the kind that runs a range of length elements
+    Kind kind_for(std::size_t length) const {
+        if(length < threshold && policy_kind != Kind::VECTORIZED) {
+            return Kind::SEQUENTIAL;
+        }
+        return policy_kind;
+    }
+
+private:
+    ExecutionPolicy(Kind kind_, ThreadPool* pool_):
+    policy_kind(kind_), pool_ptr(pool_), threshold(DEFAULT_SEQUENTIAL_THRESHOLD) {
+
+    }
+
+    Kind policy_kind;
+    ThreadPool* pool_ptr;
+    std::size_t threshold;
+};
+
+namespace policy_detail {
+
+using Kind = ExecutionPolicy::Kind;
+
+// blocks an ASYNC or THREADS call splits length elements into, a single
+// block for the other kinds
+inline std::size_t num_blocks(Kind kind, std::size_t length) {
+    std::size_t num_threads = std::max(2u, std::thread::hardware_concurrency());
+    if(kind == Kind::THREADS) {
+        return std::max<std::size_t>(1, std::min(length, num_threads));
+    }
+    if(kind == Kind::ASYNC) {
+        // a few per thread, pool tasks are cheaper than threads
+        return std::max<std::size_t>(1, std::min(length, num_threads * 4));
+    }
+    return 1;
+}
+
+// body(block, begin, end) over num_blocks(kind, length) equal blocks
+// covering [0, length). ASYNC hands the blocks to async_for_each, THREADS
+// starts a thread per block but the first, other kinds run them in order.
+// the first exception is rethrown once every block is done.
+template<typename Body>
+void run_blocks(Kind kind, std::size_t length, Body body) {
+    std::size_t blocks = length ? num_blocks(kind, length) : 0;
+    auto run_block = [length, blocks, &body](std::size_t block) {
+        body(block, length * block / blocks, length * (block + 1) / blocks);
+    };
+    if(kind == Kind::ASYNC) {
+        std::vector<std::size_t> indices(blocks);
+        std::iota(indices.begin(), indices.end(), 0);
+        async_for_each(indices.begin(), indices.end(), run_block, SimplePartitioner(1));
+    } else if(kind == Kind::THREADS) {
+        std::vector<std::future<void> > futures;
+        {
+            std::vector<std::thread> threads;
+            JoinThreads joiner(threads);
+            for(std::size_t i = 1; i < blocks; i++) {
+                std::packaged_task<void()> packaged([i, &run_block]() {
+                    run_block(i);
+                });
+                futures.push_back(packaged.get_future());
+                threads.emplace_back(std::move(packaged));
+            }
+            if(blocks) {
+                run_block(0);
+            }
+        }
+        for(auto&& future : futures) {
+            future.get();
+        }
+    } else {
+        for(std::size_t i = 0; i < blocks; i++) {
+            run_block(i);
+        }
+    }
+}
+
+}
+
+// the overloads below take the policy first and otherwise follow the std
+// algorithm of the same name. they call the existing variant of a kind
+// where there is one, POOL calls the ThreadPool algorithm with its default
+// partitioner on the policy's pool.
+
+template<typename Iterator, typename Func>
+void parallel_for_each(const ExecutionPolicy& policy, Iterator first, Iterator last, Func f) {
+    std::size_t length = std::distance(first, last);
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        parallel_for_each(first, last, f, AutoPartitioner(), *policy.thread_pool());
+        return;
+    }
+    if(kind == ExecutionPolicy::Kind::ASYNC) {
+        async_for_each(first, last, f);
+        return;
+    }
+    policy_detail::run_blocks(kind, length, [first, &f](std::size_t, std::size_t begin, std::size_t end) {
+        std::for_each(std::next(first, begin), std::next(first, end), f);
+    });
+}
+
+// the first element with pred(element), like std::find_if
+template<typename Iterator, typename Predicate>
+Iterator parallel_find_if(const ExecutionPolicy& policy, Iterator first, Iterator last, Predicate pred) {
+    std::size_t length = std::distance(first, last);
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        return parallel_find_if(first, last, pred, SearchPartitioner(), *policy.thread_pool());
+    }
+    if(kind == ExecutionPolicy::Kind::SEQUENTIAL || kind == ExecutionPolicy::Kind::VECTORIZED) {
+        return std::find_if(first, last, pred);
+    }
+    // blocks stop at a match in front of them
+    std::atomic<std::size_t> best(length);
+    policy_detail::run_blocks(kind, length, [first, &pred, &best](std::size_t, std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        for(std::size_t i = begin; i < end && i < best.load(std::memory_order_relaxed); ++i, ++it) {
+            if(pred(*it)) {
+                std::size_t current = best.load(std::memory_order_relaxed);
+                while(i < current && !best.compare_exchange_weak(current, i));
+                return;
+            }
+        }
+    });
+    return std::next(first, best.load());
+}
+
+// the first element equal to value, like std::find and parallel_find_first
+template<typename Iterator, typename T>
+Iterator parallel_find_first(const ExecutionPolicy& policy, Iterator first, Iterator last, const T& value) {
+    std::size_t length = std::distance(first, last);
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        return parallel_find_first(first, last, value, SearchPartitioner(), *policy.thread_pool());
+    }
+    if constexpr(parallel_detail::UseSimdKernels<Iterator, T>::value) {
+        if(kind == ExecutionPolicy::Kind::VECTORIZED) {
+            return length ? std::next(first, simd_find(&*first, length, value)) : last;
+        }
+    }
+    return parallel_find_if(policy, first, last, [&value](const auto& element) {
+        return element == value;
+    });
+}
+
+// init op x0 op x1 ... for an associative op, every kind combines its
+// block results in order, so op need not be commutative
+template<typename Iterator, typename T, typename ReduceOp>
+T parallel_reduce(const ExecutionPolicy& policy, Iterator first, Iterator last, T init, ReduceOp op) {
+    std::size_t length = std::distance(first, last);
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        return parallel_reduce(first, last, std::move(init), op, ReduceMode::DETERMINISTIC,
+            AutoPartitioner(), *policy.thread_pool());
+    }
+    if(kind == ExecutionPolicy::Kind::SEQUENTIAL || kind == ExecutionPolicy::Kind::VECTORIZED) {
+        return std::accumulate(first, last, std::move(init), op);
+    }
+    std::vector<CacheAligned<std::optional<T> > > partials(policy_detail::num_blocks(kind, length));
+    policy_detail::run_blocks(kind, length, [first, &op, &partials](std::size_t block, std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        T partial = *it;
+        partials[block].value = std::accumulate(++it, std::next(first, end), std::move(partial), op);
+    });
+    for(auto&& partial : partials) {
+        if(partial.value) {
+            init = op(std::move(init), std::move(*partial.value));
+        }
+    }
+    return init;
+}
+
+template<typename Iterator, typename T>
+T parallel_accumulate(const ExecutionPolicy& policy, Iterator first, Iterator last, T init) {
+    std::size_t length = std::distance(first, last);
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        return parallel_accumulate(first, last, std::move(init), AutoPartitioner(), *policy.thread_pool());
+    }
+    if constexpr(parallel_detail::UseSimdKernels<Iterator, T>::value) {
+        if(kind == ExecutionPolicy::Kind::VECTORIZED) {
+            return length ? simd_detail::add(init, simd_sum(&*first, length)) : init;
+        }
+    }
+    return parallel_reduce(policy, first, last, std::move(init), std::plus<>());
+}
+
+// d_first must be random access for ASYNC and THREADS
+template<typename Iterator, typename OutputIterator, typename UnaryOp>
+OutputIterator parallel_transform(const ExecutionPolicy& policy, Iterator first, Iterator last,
+    OutputIterator d_first, UnaryOp op) {
+    std::size_t length = std::distance(first, last);
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        return parallel_transform(first, last, d_first, op, AutoPartitioner(), *policy.thread_pool());
+    }
+    if(kind == ExecutionPolicy::Kind::SEQUENTIAL || kind == ExecutionPolicy::Kind::VECTORIZED) {
+        return std::transform(first, last, d_first, op);
+    }
+    policy_detail::run_blocks(kind, length, [first, d_first, &op](std::size_t, std::size_t begin, std::size_t end) {
+        std::transform(std::next(first, begin), std::next(first, end), std::next(d_first, begin), op);
+    });
+    return std::next(d_first, length);
+}
+
+// ASYNC is async_quick_sort, THREADS thread_pool_quick_sort
+template<typename RandomIt, typename Compare = std::less<> >
+void parallel_sort(const ExecutionPolicy& policy, RandomIt first, RandomIt last, Compare comp = Compare()) {
+    std::size_t length = last - first;
+    ExecutionPolicy::Kind kind = policy.kind_for(length);
+    if(kind == ExecutionPolicy::Kind::POOL) {
+        parallel_sort(first, last, comp, AutoPartitioner(), *policy.thread_pool());
+    } else if(kind == ExecutionPolicy::Kind::ASYNC) {
+        async_quick_sort(first, last, comp);
+    } else if(kind == ExecutionPolicy::Kind::THREADS) {
+        thread_pool_quick_sort(first, last, comp);
+    } else {
+        std::sort(first, last, comp);
+    }
+}
+
+#endif
@@ -0,0 +1,545 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+// sorts files of fixed size, trivially copyable records that do not fit in
+// memory, in two phases:
+//   runs   the input is mapped, chunks of it are copied out, sorted with
+//          parallel_sort and written to run files. two chunk buffers, the
+//          write of one run overlaps the sort of the next.
+//   merge  the output is split into one part per worker at splitter
+//          records sampled from the runs. every part merges its slice of
+//          all runs through a tournament tree, run blocks are read and
+//          output blocks written by pool tasks while the merge works on
+//          the other buffer of the pair.
+// there is a single merge pass, with many runs per byte of memory_bytes
+// the merge buffers take more than memory_bytes.
+//
+// posix only, like HashTableSnapshot.h
+
+#include "ParallelAlgorithm.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace external_sort_detail {
+
+// merge blocks never get smaller than this, whatever memory_bytes says
+constexpr std::size_t MIN_BLOCK_BYTES = 1 << 16;
+// splitter candidates read from every run per output part
+constexpr std::size_t SAMPLES_PER_PART = 8;
+
+// a file descriptor, reads and writes take explicit offsets so threads
+// can share one
+class File {
+public:
+    File():
+    fd(-1) {
+
+    }
+
+    ~File() {
+        close();
+    }
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    bool create(const std::string& path, std::size_t size) {
+        close();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) {
+            return false;
+        }
+        if(ftruncate(fd, (off_t)size) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // all of [offset, offset + bytes) or false
+    bool read_at(void* data, std::size_t bytes, std::size_t offset) const {
+        char* out = (char*)data;
+        while(bytes) {
+            ssize_t n = ::pread(fd, out, bytes, (off_t)offset);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n <= 0) {
+                return false;
+            }
+            out += n;
+            bytes -= n;
+            offset += n;
+        }
+        return true;
+    }
+
+    bool write_at(const void* data, std::size_t bytes, std::size_t offset) const {
+        const char* in = (const char*)data;
+        while(bytes) {
+            ssize_t n = ::pwrite(fd, in, bytes, (off_t)offset);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n <= 0) {
+                return false;
+            }
+            in += n;
+            bytes -= n;
+            offset += n;
+        }
+        return true;
+    }
+
+    void close() {
+        if(fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+private:
+    int fd;
+};
+
+// run files are removed whatever the outcome of the sort
+struct RunFiles {
+    ~RunFiles() {
+        for(auto&& path : paths) {
+            std::remove(path.c_str());
+        }
+    }
+
+    std::vector<std::string> paths;
+};
+
+// records [begin, end) of a run, block by block. the next block is read
+// by a pool task while the current one is consumed.
+template<typename Record>
+class RunReader {
+public:
+    RunReader(const File& file_, std::size_t begin, std::size_t end_, std::size_t block_, ThreadPool& pool_):
+    file(&file_), next(begin), end(end_), block(block_), pool(&pool_), front(1), pos(0), ok(true) {
+        buffers[0].resize(std::min(block, end - next));
+        buffers[1].resize(buffers[0].size());
+        counts[1] = 0;
+        prefetch();
+        next_block();
+    }
+
+    ~RunReader() {
+        // the pending read writes into this reader's buffer
+        if(pending.valid()) {
+            pool->wait(pending);
+        }
+    }
+
+    RunReader(const RunReader&) = delete;
+    RunReader& operator=(const RunReader&) = delete;
+
+    bool exhausted() const {
+        return counts[front] == 0;
+    }
+
+    const Record& current() const {
+        return buffers[front][pos];
+    }
+
+    void advance() {
+        if(++pos >= counts[front]) {
+            next_block();
+        }
+    }
+
+    bool failed() const {
+        return !ok;
+    }
+
+private:
+    void prefetch() {
+        int back = front ^ 1;
+        std::size_t n = std::min(block, end - next);
+        counts[back] = n;
+        if(!n) {
+            return;
+        }
+        std::size_t offset = next * sizeof(Record);
+        next += n;
+        const File* source = file;
+        Record* data = buffers[back].data();
+        pending = pool->submit([source, data, n, offset]() {
+            return source->read_at(data, n * sizeof(Record), offset);
+        });
+    }
+
+    void next_block() {
+        if(pending.valid()) {
+            pool->wait(pending);
+            if(!pending.get()) {
+                // stop here, the caller checks failed()
+                ok = false;
+                counts[front ^ 1] = 0;
+            }
+        }
+        front ^= 1;
+        pos = 0;
+        if(counts[front]) {
+            prefetch();
+        }
+    }
+
+    const File* file;
+    std::size_t next;
+    std::size_t end;
+    std::size_t block;
+    ThreadPool* pool;
+    std::vector<Record> buffers[2];
+    std::size_t counts[2];
+    int front;
+    std::size_t pos;
+    std::future<bool> pending;
+    bool ok;
+};
+
+// writes records from offset on, a full block is written by a pool task
+// while the next one is filled
+template<typename Record>
+class BlockWriter {
+public:
+    BlockWriter(const File& file_, std::size_t offset_, std::size_t block_, ThreadPool& pool_):
+    file(&file_), offset(offset_), block(block_), pool(&pool_), front(0), filled(0), ok(true) {
+        buffers[0].resize(block);
+        buffers[1].resize(block);
+    }
+
+    ~BlockWriter() {
+        for(auto&& write : pending) {
+            if(write.valid()) {
+                pool->wait(write);
+            }
+        }
+    }
+
+    BlockWriter(const BlockWriter&) = delete;
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+    void push(const Record& record) {
+        buffers[front][filled++] = record;
+        if(filled == block) {
+            flush();
+        }
+    }
+
+    // false if any write failed
+    bool finish() {
+        flush();
+        for(auto&& write : pending) {
+            if(write.valid()) {
+                pool->wait(write);
+                ok = write.get() && ok;
+            }
+        }
+        return ok;
+    }
+
+private:
+    void flush() {
+        if(!filled) {
+            return;
+        }
+        const File* target = file;
+        const Record* data = buffers[front].data();
+        std::size_t bytes = filled * sizeof(Record);
+        std::size_t at = offset * sizeof(Record);
+        pending[front] = pool->submit([target, data, bytes, at]() {
+            return target->write_at(data, bytes, at);
+        });
+        offset += filled;
+        filled = 0;
+        front ^= 1;
+        // the buffer filled next may still be on its way out
+        if(pending[front].valid()) {
+            pool->wait(pending[front]);
+            ok = pending[front].get() && ok;
+        }
+    }
+
+    const File* file;
+    std::size_t offset;
+    std::size_t block;
+    ThreadPool* pool;
+    std::vector<Record> buffers[2];
+    std::future<bool> pending[2];
+    int front;
+    std::size_t filled;
+    bool ok;
+};
+
+// tournament tree over k sorted readers. tree[0] is the reader with the
+// smallest current record, every inner node keeps the loser of the match
+// played there, so after the winner advances only its leaf to root path
+// is replayed: log k comparisons per record.
+template<typename Record, typename Compare>
+class LoserTree {
+public:
+    LoserTree(std::vector<std::unique_ptr<RunReader<Record> > >& readers_, Compare& comp_):
+    readers(readers_), comp(comp_), k(readers_.size()), tree(std::max<std::size_t>(1, readers_.size())) {
+        if(k) {
+            tree[0] = build(1);
+        }
+    }
+
+    bool empty() const {
+        return !k || readers[tree[0]]->exhausted();
+    }
+
+    RunReader<Record>& top() {
+        return *readers[tree[0]];
+    }
+
+    // after top() advanced
+    void replay() {
+        std::size_t winner = tree[0];
+        for(std::size_t node = (winner + k) / 2; node > 0; node /= 2) {
+            if(beats(tree[node], winner)) {
+                std::swap(tree[node], winner);
+            }
+        }
+        tree[0] = winner;
+    }
+
+private:
+    // leaves are the nodes k .. 2k - 1
+    std::size_t build(std::size_t node) {
+        if(node >= k) {
+            return node - k;
+        }
+        std::size_t left = build(2 * node);
+        std::size_t right = build(2 * node + 1);
+        if(beats(left, right)) {
+            tree[node] = right;
+            return left;
+        }
+        tree[node] = left;
+        return right;
+    }
+
+    // exhausted readers lose, ties go to the earlier run
+    bool beats(std::size_t a, std::size_t b) const {
+        if(readers[a]->exhausted()) {
+            return false;
+        }
+        if(readers[b]->exhausted()) {
+            return true;
+        }
+        if(comp(readers[a]->current(), readers[b]->current())) {
+            return true;
+        }
+        if(comp(readers[b]->current(), readers[a]->current())) {
+            return false;
+        }
+        return a < b;
+    }
+
+    std::vector<std::unique_ptr<RunReader<Record> > >& readers;
+    Compare& comp;
+    std::size_t k;
+    std::vector<std::size_t> tree;
+};
+
+// index of the first record of the run that value sorts before
+template<typename Record, typename Compare>
+std::optional<std::size_t> run_upper_bound(const File& run, std::size_t length, const Record& value, Compare& comp) {
+    std::size_t low = 0, high = length;
+    while(low < high) {
+        std::size_t mid = low + (high - low) / 2;
+        Record record;
+        if(!run.read_at(&record, sizeof(Record), mid * sizeof(Record))) {
+            return std::nullopt;
+        }
+        if(comp(value, record)) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+// merges [begins[r], ends[r]) of every run r to the output from offset on
+template<typename Record, typename Compare>
+bool merge_part(const std::vector<File>& runs, const std::vector<std::size_t>& begins, const std::vector<std::size_t>& ends,
+    const File& output, std::size_t offset, std::size_t block, Compare& comp, ThreadPool& pool) {
+    std::vector<std::unique_ptr<RunReader<Record> > > readers;
+    for(std::size_t r = 0; r < runs.size(); r++) {
+        if(begins[r] < ends[r]) {
+            readers.push_back(std::make_unique<RunReader<Record> >(runs[r], begins[r], ends[r], block, pool));
+        }
+    }
+    BlockWriter<Record> writer(output, offset, block, pool);
+    LoserTree<Record, Compare> tree(readers, comp);
+    while(!tree.empty()) {
+        RunReader<Record>& reader = tree.top();
+        writer.push(reader.current());
+        reader.advance();
+        tree.replay();
+    }
+    bool ok = writer.finish();
+    for(auto&& reader : readers) {
+        ok = ok && !reader->failed();
+    }
+    return ok;
+}
+
+}
+
+// sorts the records of the file at input into output, which may not be
+// the input. memory_bytes bounds the buffers of run generation,
+// runs are written next to the output as output.run<i> and removed
+// afterwards. returns false if a file could not be opened, read or
+// written, or if the input size is not a multiple of the record size.
+template<typename Record, typename Compare = std::less<> >
+bool external_sort(const std::string& input, const std::string& output, std::size_t memory_bytes,
+    Compare comp = Compare(), ThreadPool& pool = ThreadPool::default_pool()) {
+    static_assert(std::is_trivially_copyable<Record>::value, "external_sort needs trivially copyable records");
+    using namespace external_sort_detail;
+
+    struct stat st;
+    if(stat(input.c_str(), &st) != 0 || st.st_size % sizeof(Record) != 0) {
+        return false;
+    }
+    std::size_t length = (std::size_t)st.st_size / sizeof(Record);
+    File out;
+    if(!out.create(output, length * sizeof(Record))) {
+        return false;
+    }
+    if(!length) {
+        return true;
+    }
+    MappedFile in;
+    if(!in.open_read(input)) {
+        return false;
+    }
+    const Record* records = (const Record*)in.get();
+
+    // runs: two chunk buffers, one is sorted while the other is written,
+    // and the merge buffer of parallel_sort
+    std::size_t run_length = std::max<std::size_t>(1, memory_bytes / 3 / sizeof(Record));
+    std::size_t num_runs = (length + run_length - 1) / run_length;
+    RunFiles run_files;
+    std::vector<File> runs(num_runs);
+    std::vector<std::size_t> run_lengths(num_runs);
+    std::vector<Record> buffers[2];
+    std::future<bool> writes[2];
+    bool ok = true;
+    for(std::size_t i = 0; i < num_runs && ok; i++) {
+        std::vector<Record>& buffer = buffers[i % 2];
+        std::future<bool>& write = writes[i % 2];
+        if(write.valid()) {
+            pool.wait(write);
+            if(!write.get()) {
+                ok = false;
+                break;
+            }
+        }
+        std::size_t begin = i * run_length;
+        run_lengths[i] = std::min(run_length, length - begin);
+        buffer.resize(run_lengths[i]);
+        // copying in parallel also faults the mapped pages in in parallel
+        parallel_for_range(buffer.size(), [&buffer, records, begin](std::size_t first, std::size_t last) {
+            std::memcpy(buffer.data() + first, records + begin + first, (last - first) * sizeof(Record));
+        }, AutoPartitioner(), pool);
+        parallel_sort(buffer.begin(), buffer.end(), comp, AutoPartitioner(), pool);
+
+        // a single run is the output already
+        const File* target = &out;
+        if(num_runs > 1) {
+            run_files.paths.push_back(output + ".run" + std::to_string(i));
+            if(!runs[i].create(run_files.paths.back(), buffer.size() * sizeof(Record))) {
+                ok = false;
+                break;
+            }
+            target = &runs[i];
+        }
+        const Record* data = buffer.data();
+        std::size_t bytes = buffer.size() * sizeof(Record);
+        write = pool.submit([target, data, bytes]() {
+            return target->write_at(data, bytes, 0);
+        });
+    }
+    for(auto&& write : writes) {
+        if(write.valid()) {
+            pool.wait(write);
+            ok = write.get() && ok;
+        }
+    }
+    in.close();
+    if(!ok || num_runs == 1) {
+        return ok;
+    }
+    std::vector<Record>().swap(buffers[0]);
+    std::vector<Record>().swap(buffers[1]);
+
+    // splitters: part p gets the records after splitter p - 1, up to and
+    // including splitter p
+    std::size_t num_parts = std::max<std::size_t>(1, std::min<std::size_t>(pool.size() + 1, length / run_length));
+    std::vector<Record> samples;
+    std::size_t samples_per_run = SAMPLES_PER_PART * num_parts;
+    for(std::size_t r = 0; r < num_runs; r++) {
+        for(std::size_t j = 0; j < samples_per_run; j++) {
+            Record record;
+            std::size_t at = run_lengths[r] * (2 * j + 1) / (2 * samples_per_run);
+            if(!runs[r].read_at(&record, sizeof(Record), at * sizeof(Record))) {
+                return false;
+            }
+            samples.push_back(record);
+        }
+    }
+    std::sort(samples.begin(), samples.end(), comp);
+
+    // bounds[p][r], first record of run r in part p
+    std::vector<std::vector<std::size_t> > bounds(num_parts + 1, std::vector<std::size_t>(num_runs, 0));
+    bounds[num_parts] = run_lengths;
+    std::vector<std::size_t> offsets(num_parts + 1, 0);
+    for(std::size_t p = 1; p < num_parts; p++) {
+        const Record& splitter = samples[samples.size() * p / num_parts];
+        for(std::size_t r = 0; r < num_runs; r++) {
+            std::optional<std::size_t> bound = run_upper_bound(runs[r], run_lengths[r], splitter, comp);
+            if(!bound) {
+                return false;
+            }
+            bounds[p][r] = *bound;
+            offsets[p] += *bound;
+        }
+    }
+
+    // a read and a write buffer pair per run and part
+    std::size_t block = std::max(MIN_BLOCK_BYTES / sizeof(Record) + 1,
+        memory_bytes / (sizeof(Record) * num_parts * (2 * num_runs + 2)));
+    std::atomic<bool> merged(true);
+    parallel_detail::run_chunks(num_parts, 1, [&](int, std::size_t p, std::size_t) {
+        if(!merge_part<Record>(runs, bounds[p], bounds[p + 1], out, offsets[p], block, comp, pool)) {
+            merged.store(false);
+        }
+    }, pool);
+    return merged.load();
+}
+
+#endif
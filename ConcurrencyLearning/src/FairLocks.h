@@ -0,0 +1,182 @@
+#ifndef FAIRLOCKS_H
+#define FAIRLOCKS_H
+
+#include "SpinLockMutex.h"
+#include "CacheLine.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// FIFO ticket lock: a thread draws a ticket and waits until it is served.
+// the two counters live on separate cache lines so drawing a ticket does
+// not disturb the line the waiters poll. waiters back off proportionally
+// to their distance from the head of the line.
+// a FIFO handoff stalls whenever the next owner is off cpu, so waiters
+// far back in the line, or waiting for long, yield their cpu.
+class TicketLock {
+public:
+	TicketLock():
+	next_ticket(0), now_serving(0) {
+
+	}
+
+	void lock() {
+		std::uint32_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+		int polls = 0;
+		while (true) {
+			std::uint32_t serving = now_serving.load(std::memory_order_acquire);
+			if (serving == ticket) {
+				return;
+			}
+			std::uint32_t distance = ticket - serving;
+			if (distance > MAX_SPIN_DISTANCE || ++polls >= MAX_POLLS) {
+				std::this_thread::yield();
+				polls = 0;
+			} else {
+				for (std::uint32_t i = 0; i < distance * BACKOFF_PER_WAITER; i++) {
+					cpu_relax();
+				}
+			}
+		}
+	}
+
+	bool try_lock() {
+		std::uint32_t serving = now_serving.load(std::memory_order_acquire);
+		std::uint32_t ticket = serving;
+		return next_ticket.compare_exchange_strong(ticket, serving + 1,
+			std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock() {
+		// only the holder writes now_serving
+		now_serving.store(now_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+private:
+	static constexpr std::uint32_t BACKOFF_PER_WAITER = 32;
+	static constexpr std::uint32_t MAX_SPIN_DISTANCE = 8;
+	static constexpr int MAX_POLLS = 16;
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> next_ticket;
+	alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> now_serving;
+};
+
+// MCS queue lock: waiters form a linked queue and each one spins on the
+// flag in its own cache line, a release touches only the successor's line.
+// queue nodes come from a per thread cache, so the lock keeps the plain
+// lock()/unlock() interface; the holder remembers its node in the lock.
+class MCSLock {
+private:
+	struct alignas(CACHE_LINE_SIZE) QNode {
+		std::atomic<QNode*> next;
+		std::atomic<bool> locked;
+	};
+
+	// per thread free list of nodes, a thread needs one node per lock it
+	// is holding or waiting for at the same time
+	struct NodeCache {
+		~NodeCache() {
+			for (QNode* node : nodes) {
+				delete node;
+			}
+		}
+
+		QNode* acquire() {
+			if (nodes.empty()) {
+				return new QNode;
+			}
+			QNode* node = nodes.back();
+			nodes.pop_back();
+			return node;
+		}
+
+		void release(QNode* node) {
+			nodes.push_back(node);
+		}
+
+		std::vector<QNode*> nodes;
+	};
+
+public:
+	MCSLock():
+	tail(nullptr), holder(nullptr) {
+
+	}
+
+	void lock() {
+		QNode* node = node_cache().acquire();
+		node->next.store(nullptr, std::memory_order_relaxed);
+		node->locked.store(true, std::memory_order_relaxed);
+
+		QNode* pred = tail.exchange(node, std::memory_order_acq_rel);
+		if (pred) {
+			pred->next.store(node, std::memory_order_release);
+			spin_while_set(node->locked);
+		}
+		holder = node;
+	}
+
+	bool try_lock() {
+		QNode* node = node_cache().acquire();
+		node->next.store(nullptr, std::memory_order_relaxed);
+		node->locked.store(false, std::memory_order_relaxed);
+		QNode* expect = nullptr;
+		if (tail.compare_exchange_strong(expect, node, std::memory_order_acquire, std::memory_order_relaxed)) {
+			holder = node;
+			return true;
+		}
+		node_cache().release(node);
+		return false;
+	}
+
+	void unlock() {
+		QNode* node = holder;
+		QNode* succ = node->next.load(std::memory_order_acquire);
+		if (!succ) {
+			QNode* expect = node;
+			if (tail.compare_exchange_strong(expect, nullptr, std::memory_order_release, std::memory_order_relaxed)) {
+				node_cache().release(node);
+				return;
+			}
+			// a successor swapped the tail but has not linked itself yet
+			int spins = 0;
+			while (!(succ = node->next.load(std::memory_order_acquire))) {
+				cpu_relax();
+				if (++spins >= MAX_SPINS) {
+					std::this_thread::yield();
+					spins = 0;
+				}
+			}
+		}
+		succ->locked.store(false, std::memory_order_release);
+		node_cache().release(node);
+	}
+
+private:
+	static NodeCache& node_cache() {
+		thread_local NodeCache cache;
+		return cache;
+	}
+
+	static void spin_while_set(std::atomic<bool>& flag) {
+		int spins = 0;
+		while (flag.load(std::memory_order_acquire)) {
+			cpu_relax();
+			// FIFO handoff stalls if the next owner is off cpu, give way
+			// when the machine looks oversubscribed
+			if (++spins >= MAX_SPINS) {
+				std::this_thread::yield();
+				spins = 0;
+			}
+		}
+	}
+
+	static constexpr int MAX_SPINS = 128;
+
+	alignas(CACHE_LINE_SIZE) std::atomic<QNode*> tail;
+	// written by the owner only, read by the owner in unlock
+	QNode* holder;
+};
+
+#endif
@@ -3,8 +3,11 @@
 
 #include <mutex>
 #include <condition_variable>
+#include <type_traits>
+#include "LockProfiler.h"
 
-template<typename T>
+// Mutex is any Lockable, std::condition_variable is only used with std::mutex
+template<typename T, typename Mutex = std::mutex>
 class FineGrainedLockQueue {
 private:
 	struct Node {
@@ -15,74 +18,86 @@ private:
 public:
 	FineGrainedLockQueue():
 	head(new Node), tail(head), length(0) {
-
+		name_lock_site(head_mut, "FineGrainedLockQueue.head");
+		name_lock_site(tail_mut, "FineGrainedLockQueue.tail");
+		name_lock_site(size_mut, "FineGrainedLockQueue.size");
 	}
 
 	void push(const T& value) {
 		Node* new_node = new Node;
 		{
-			std::lock_guard<std::mutex> lk(tail_mut);
+			std::lock_guard<Mutex> lk(tail_mut);
 			tail->data = value;
 			tail->next = new_node;
 			tail = new_node;
 		}
 		{
-			std::lock_guard<std::mutex> size_lk(size_mut);
+			std::lock_guard<Mutex> size_lk(size_mut);
 			length++;
 		}
+		{
+			// a waiter checks the tail under head_mut, passing through it
+			// makes sure the waiter is either asleep or sees the new node
+			std::lock_guard<Mutex> head_lk(head_mut);
+		}
 		data_cv.notify_one();
 	}
 
 	void push(T&& value) {
 		Node* new_node = new Node;
 		{
-			std::lock_guard<std::mutex> lk(tail_mut);
+			std::lock_guard<Mutex> lk(tail_mut);
 			tail->data = std::move(value);
 			tail->next = new_node;
 			tail = new_node;
 		}
 		{
-			std::lock_guard<std::mutex> size_lk(size_mut);
+			std::lock_guard<Mutex> size_lk(size_mut);
 			length++;
 		}
+		{
+			// a waiter checks the tail under head_mut, passing through it
+			// makes sure the waiter is either asleep or sees the new node
+			std::lock_guard<Mutex> head_lk(head_mut);
+		}
 		data_cv.notify_one();		
 	}
 
 	void wait_and_pop(T& value) {
-		std::unique_lock<std::mutex> lk(head_mut);
+		std::unique_lock<Mutex> lk(head_mut);
 		data_cv.wait(lk, [this]() {
 			return this->head != this->get_tail();
 		});
 		value = std::move(head->data);
 		pop_head();
 		{
-			std::lock_guard<std::mutex> size_lk(size_mut);
+			std::lock_guard<Mutex> size_lk(size_mut);
 			length--;
 		}
 		return;
 	}
 
 	bool try_pop(T& value) {
-		std::lock_guard<std::mutex> lk(head_mut);
+		std::lock_guard<Mutex> lk(head_mut);
 		if (head == get_tail()) {
 			return false;
 		}
 		value = std::move(head->data);
 		pop_head();
 		{
-			std::lock_guard<std::mutex> size_lk(size_mut);
+			std::lock_guard<Mutex> size_lk(size_mut);
 			length--;
 		}
 		return true;
 	}
 
 	bool empty() const {
-		std::lock_guard<std::mutex> lk(head_mut);
+		std::lock_guard<Mutex> lk(head_mut);
 		return head == get_tail();
 	}
 
 	int size() const {
-		std::lock_guard<std::mutex> lk(size_mut);
+		std::lock_guard<Mutex> lk(size_mut);
 		return length;
 	}
 
@@ -94,17 +109,18 @@ private:
 	}
 
 	Node* get_tail() const {
-		std::lock_guard<std::mutex> lk(tail_mut);
+		std::lock_guard<Mutex> lk(tail_mut);
 		return tail;
 	}
 
 	int length;		// may use atomic has better performance
 	Node* head;
 	Node* tail;
-	mutable std::mutex head_mut;
-	mutable std::mutex tail_mut;
-	mutable std::mutex size_mut;
-	std::condition_variable data_cv;
+	mutable Mutex head_mut;
+	mutable Mutex tail_mut;
+	mutable Mutex size_mut;
+	std::conditional_t<std::is_same<Mutex, std::mutex>::value,
+		std::condition_variable, std::condition_variable_any> data_cv;
 };
 
 #endif // !FINEGRAINEDLOCKQUEUE_H
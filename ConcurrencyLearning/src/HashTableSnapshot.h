@@ -0,0 +1,269 @@
+#ifndef HASHTABLESNAPSHOT_H
+#define HASHTABLESNAPSHOT_H
+
+// binary snapshot of a ThreadSafeHashTable with trivially copyable keys
+// and values, written and loaded in parallel by bucket through mmap.
+//
+// file layout:
+//   SnapshotHeader
+//   uint64_t bucket_offsets[num_buckets + 1]   first entry of every bucket
+//   padding up to a cache line
+//   SnapshotEntry<K, V> entries[num_entries]   grouped by bucket
+//
+// posix only, like InputSystem.h is windows only
+
+#include "ThreadSafeHashTable.h"
+#include "ThreadPool.h"
+#include "Partitioner.h"
+#include "CacheLine.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include <type_traits>
+
+struct SnapshotHeader {
+	std::uint64_t magic;
+	std::uint32_t version;
+	std::uint32_t key_size;
+	std::uint32_t value_size;
+	std::uint32_t entry_size;
+	std::uint64_t num_buckets;
+	std::uint64_t num_entries;
+	std::uint64_t entries_offset;
+
+	static constexpr std::uint64_t MAGIC = 0x50414e5348544854ull;	// "THTHSNAP"
+	static constexpr std::uint32_t VERSION = 1;
+};
+
+// member names follow std::pair so entries feed insert_into_bucket directly
+template<typename K, typename V>
+struct SnapshotEntry {
+	K first;
+	V second;
+};
+
+namespace snapshot_detail {
+
+inline std::uint64_t entries_offset(std::uint64_t num_buckets) {
+	std::uint64_t offset = sizeof(SnapshotHeader) + (num_buckets + 1) * sizeof(std::uint64_t);
+	return (offset + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+// buckets per chunk, at least 16 so small tables stay on one thread
+inline std::size_t bucket_grain(std::size_t num_buckets, const ThreadPool& pool) {
+	return std::max<std::size_t>(16, resolve_grain_size(AutoPartitioner(), num_buckets, pool));
+}
+
+template<typename K, typename V>
+bool valid_header(const MappedFile& file) {
+	if (file.size() < sizeof(SnapshotHeader)) {
+		return false;
+	}
+	const SnapshotHeader* header = (const SnapshotHeader*)file.get();
+	if (header->magic != SnapshotHeader::MAGIC || header->version != SnapshotHeader::VERSION
+		|| header->key_size != sizeof(K) || header->value_size != sizeof(V)
+		|| header->entry_size != sizeof(SnapshotEntry<K, V>) || header->num_buckets == 0
+		|| header->num_buckets > file.size() / sizeof(std::uint64_t)
+		|| header->num_entries > file.size() / sizeof(SnapshotEntry<K, V>)) {
+		return false;
+	}
+	if (header->entries_offset != entries_offset(header->num_buckets)
+		|| header->entries_offset > file.size()
+		|| header->num_entries * sizeof(SnapshotEntry<K, V>) > file.size() - header->entries_offset) {
+		return false;
+	}
+	// readers index entries + bucket_offsets[i] directly
+	const std::uint64_t* bucket_offsets = (const std::uint64_t*)(file.get() + sizeof(SnapshotHeader));
+	if (bucket_offsets[0] != 0 || bucket_offsets[header->num_buckets] != header->num_entries) {
+		return false;
+	}
+	for (std::uint64_t i = 0; i < header->num_buckets; i++) {
+		if (bucket_offsets[i] > bucket_offsets[i + 1]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+// every bucket is copied under its own lock, so the file has the same
+// per-bucket consistency as ThreadSafeHashTable::for_each
+template<typename K, typename V, typename Hash, typename Mutex>
+bool save_snapshot(const ThreadSafeHashTable<K, V, Hash, Mutex>& table, const std::string& path,
+	ThreadPool& pool = ThreadPool::default_pool()) {
+	static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+		"snapshots need trivially copyable keys and values");
+	typedef SnapshotEntry<K, V> Entry;
+
+	std::size_t num_buckets = table.bucket_count();
+	std::size_t grain = snapshot_detail::bucket_grain(num_buckets, pool);
+	std::vector<std::uint64_t> bucket_sizes(num_buckets, 0);
+	std::vector< std::vector<Entry> > chunk_entries((num_buckets + grain - 1) / grain);
+
+	// pass 1: copy out every chunk of buckets
+	parallel_detail::run_chunks(num_buckets, grain, [&](int, std::size_t start, std::size_t end) {
+		std::vector<Entry>& entries = chunk_entries[start / grain];
+		for (std::size_t i = start; i < end; i++) {
+			std::size_t before = entries.size();
+			table.for_each_in_bucket(i, [&entries](const K& key, const V& value) {
+				entries.push_back(Entry{ key, value });
+			});
+			bucket_sizes[i] = entries.size() - before;
+		}
+	}, pool);
+
+	std::vector<std::uint64_t> bucket_offsets(num_buckets + 1, 0);
+	for (std::size_t i = 0; i < num_buckets; i++) {
+		bucket_offsets[i + 1] = bucket_offsets[i] + bucket_sizes[i];
+	}
+	std::uint64_t num_entries = bucket_offsets[num_buckets];
+
+	SnapshotHeader header;
+	header.magic = SnapshotHeader::MAGIC;
+	header.version = SnapshotHeader::VERSION;
+	header.key_size = sizeof(K);
+	header.value_size = sizeof(V);
+	header.entry_size = sizeof(Entry);
+	header.num_buckets = num_buckets;
+	header.num_entries = num_entries;
+	header.entries_offset = snapshot_detail::entries_offset(num_buckets);
+
+	MappedFile file;
+	if (!file.create(path, header.entries_offset + num_entries * sizeof(Entry))) {
+		return false;
+	}
+	std::memcpy(file.get(), &header, sizeof(header));
+	std::memcpy(file.get() + sizeof(header), bucket_offsets.data(), bucket_offsets.size() * sizeof(std::uint64_t));
+
+	// pass 2: every chunk lands at its precomputed offset, no coordination needed
+	Entry* entries = (Entry*)(file.get() + header.entries_offset);
+	parallel_detail::run_chunks(num_buckets, grain, [&](int, std::size_t start, std::size_t) {
+		const std::vector<Entry>& local = chunk_entries[start / grain];
+		if (!local.empty()) {
+			std::memcpy(entries + bucket_offsets[start], local.data(), local.size() * sizeof(Entry));
+		}
+	}, pool);
+
+	return file.sync();
+}
+
+// bulk load a snapshot into table. when the bucket count and hash agree
+// with the writer, each chunk of buckets is filled with one lock per bucket,
+// otherwise entries are spread through insert_or_update.
+template<typename K, typename V, typename Hash, typename Mutex>
+bool load_snapshot(ThreadSafeHashTable<K, V, Hash, Mutex>& table, const std::string& path,
+	ThreadPool& pool = ThreadPool::default_pool()) {
+	static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+		"snapshots need trivially copyable keys and values");
+	typedef SnapshotEntry<K, V> Entry;
+
+	MappedFile file;
+	if (!file.open_read(path) || !snapshot_detail::valid_header<K, V>(file)) {
+		return false;
+	}
+	const SnapshotHeader* header = (const SnapshotHeader*)file.get();
+	const std::uint64_t* bucket_offsets = (const std::uint64_t*)(file.get() + sizeof(SnapshotHeader));
+	const Entry* entries = (const Entry*)(file.get() + header->entries_offset);
+	std::size_t num_buckets = header->num_buckets;
+	bool same_layout = num_buckets == table.bucket_count();
+	// a writer with another hash can agree on some keys by chance, so every
+	// entry is checked before a bucket is taken over whole
+	auto in_bucket = [&table](const Entry* first, const Entry* last, std::size_t i) {
+		for (; first != last; ++first) {
+			if (table.bucket_index(first->first) != i) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	std::size_t grain = snapshot_detail::bucket_grain(num_buckets, pool);
+	parallel_detail::run_chunks(num_buckets, grain, [&](int, std::size_t start, std::size_t end) {
+		for (std::size_t i = start; i < end; i++) {
+			const Entry* first = entries + bucket_offsets[i];
+			const Entry* last = entries + bucket_offsets[i + 1];
+			if (first == last) {
+				continue;
+			}
+			if (same_layout && in_bucket(first, last, i)) {
+				table.insert_into_bucket(i, first, last);
+			}
+			else {
+				for (; first != last; ++first) {
+					table.insert_or_update(first->first, first->second);
+				}
+			}
+		}
+	}, pool);
+	return true;
+}
+
+// zero-copy, read-only view serving lookups straight from the mapped file.
+// Hash must be the hash the snapshot was written with.
+template<typename K, typename V, typename Hash=std::hash<K> >
+class MappedSnapshot {
+private:
+	typedef SnapshotEntry<K, V> Entry;
+
+public:
+	MappedSnapshot(const Hash& hasher_ = Hash()):
+	header(nullptr), bucket_offsets(nullptr), entries(nullptr), hasher(hasher_) {
+
+	}
+
+	bool open(const std::string& path) {
+		header = nullptr;
+		if (!file.open_read(path) || !snapshot_detail::valid_header<K, V>(file)) {
+			file.close();
+			return false;
+		}
+		header = (const SnapshotHeader*)file.get();
+		bucket_offsets = (const std::uint64_t*)(file.get() + sizeof(SnapshotHeader));
+		entries = (const Entry*)(file.get() + header->entries_offset);
+		return true;
+	}
+
+	bool is_open() const {
+		return header != nullptr;
+	}
+
+	std::optional<V> get(const K& key) const {
+		std::optional<V> opt_value;
+		if (!header) {
+			return opt_value;
+		}
+		std::size_t index = hasher(key) % header->num_buckets;
+		for (std::uint64_t i = bucket_offsets[index]; i < bucket_offsets[index + 1]; i++) {
+			if (entries[i].first == key) {
+				opt_value = entries[i].second;
+				break;
+			}
+		}
+		return opt_value;
+	}
+
+	std::size_t size() const {
+		return header ? (std::size_t)header->num_entries : 0;
+	}
+
+	template<typename Func>
+	void for_each(Func f) const {
+		for (std::size_t i = 0; i < size(); i++) {
+			f(entries[i].first, entries[i].second);
+		}
+	}
+
+private:
+	MappedFile file;
+	const SnapshotHeader* header;
+	const std::uint64_t* bucket_offsets;
+	const Entry* entries;
+	Hash hasher;
+};
+
+#endif // !HASHTABLESNAPSHOT_H
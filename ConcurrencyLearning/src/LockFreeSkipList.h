@@ -0,0 +1,319 @@
+#ifndef LOCKFREESKIPLIST_H
+#define LOCKFREESKIPLIST_H
+
+#include "EpochReclamation.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <variant>
+#include <random>
+
+// lock-free ordered map, Herlihy & Shavit / Fraser style skip list.
+// a node is logically deleted by marking the low bit of its next pointers
+// (top level first, level 0 last, the level 0 mark is the linearization point),
+// later traversals physically unlink marked nodes.
+// nodes are freed through EpochManager once both the inserter and the
+// eraser are done with them, values are immutable after insert.
+template<typename K, typename V, typename Compare=std::less<K> >
+class LockFreeSkipList {
+private:
+    static constexpr int MAX_LEVEL = 24;
+
+    struct Node {
+        Node(const K& key_, const V& value_, int level_):
+        key(key_), value(value_), level(level_),
+        next(new std::atomic<std::uintptr_t>[level_]), refs(2) {
+            for(int i = 0; i < level; i++) {
+                next[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        ~Node() {
+            delete[] next;
+        }
+
+        const K key;
+        const V value;
+        const int level;
+        std::atomic<std::uintptr_t>* next;
+        // one reference for the inserter, one for the eraser
+        std::atomic<int> refs;
+    };
+
+public:
+    LockFreeSkipList(const Compare& comp_ = Compare()):
+    comp(comp_), count(0) {
+        for(int i = 0; i < MAX_LEVEL; i++) {
+            head[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~LockFreeSkipList() {
+        // no concurrent users left, erased nodes are owned by EpochManager
+        std::uintptr_t curr = head[0].load();
+        while(Node* node = get_ptr(curr)) {
+            curr = node->next[0].load();
+            if(!is_marked(curr)) {
+                delete node;
+            }
+        }
+    }
+
+    LockFreeSkipList(const LockFreeSkipList&) = delete;
+    LockFreeSkipList& operator=(const LockFreeSkipList&) = delete;
+
+    // returns false if the key is present already
+    bool insert(const K& key, const V& value = V()) {
+        EpochGuard guard;
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+        int top_level = random_level();
+        Node* new_node = nullptr;
+
+        while(true) {
+            if(find(key, preds, succs)) {
+                delete new_node;
+                return false;
+            }
+            if(!new_node) {
+                new_node = new Node(key, value, top_level);
+            }
+            for(int level = 0; level < top_level; level++) {
+                new_node->next[level].store(to_raw(succs[level]), std::memory_order_relaxed);
+            }
+            std::uintptr_t expect = to_raw(succs[0]);
+            if(link(preds[0], 0).compare_exchange_strong(expect, to_raw(new_node),
+                std::memory_order_release, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        count.fetch_add(1, std::memory_order_relaxed);
+
+        // index levels, give up as soon as an eraser marked the node
+        for(int level = 1; level < top_level; level++) {
+            bool linked = false;
+            while(!linked) {
+                std::uintptr_t node_next = new_node->next[level].load(std::memory_order_acquire);
+                if(is_marked(node_next)) {
+                    break;
+                }
+                if(get_ptr(node_next) != succs[level] &&
+                    !new_node->next[level].compare_exchange_strong(node_next, to_raw(succs[level]))) {
+                    continue;
+                }
+                std::uintptr_t expect = to_raw(succs[level]);
+                if(link(preds[level], level).compare_exchange_strong(expect, to_raw(new_node))) {
+                    linked = true;
+                } else {
+                    find(key, preds, succs);
+                    if(succs[0] != new_node) {
+                        break;
+                    }
+                }
+            }
+            if(!linked) {
+                break;
+            }
+        }
+
+        // an eraser may have finished before the last level got linked,
+        // unlink whatever we added after its cleanup
+        if(is_marked(new_node->next[0].load(std::memory_order_acquire))) {
+            find(key, preds, succs);
+        }
+        release(new_node);
+        return true;
+    }
+
+    bool erase(const K& key) {
+        EpochGuard guard;
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+        if(!find(key, preds, succs)) {
+            return false;
+        }
+        Node* victim = succs[0];
+        for(int level = victim->level - 1; level > 0; level--) {
+            std::uintptr_t succ = victim->next[level].load(std::memory_order_acquire);
+            while(!is_marked(succ)) {
+                victim->next[level].compare_exchange_weak(succ, succ | MARK);
+            }
+        }
+
+        std::uintptr_t succ = victim->next[0].load(std::memory_order_acquire);
+        while(!is_marked(succ)) {
+            if(victim->next[0].compare_exchange_weak(succ, succ | MARK)) {
+                count.fetch_sub(1, std::memory_order_relaxed);
+                // physically unlink from every level
+                find(key, preds, succs);
+                release(victim);
+                return true;
+            }
+        }
+        // another eraser won
+        return false;
+    }
+
+    bool contains(const K& key) const {
+        EpochGuard guard;
+        return search(key) != nullptr;
+    }
+
+    std::optional<V> get(const K& key) const {
+        EpochGuard guard;
+        std::optional<V> opt_value;
+        if(Node* node = search(key)) {
+            opt_value = node->value;
+        }
+        return opt_value;
+    }
+
+    // f(key, value) for every key in [low, high) in order.
+    // weakly consistent: keys inserted or erased during the scan
+    // may or may not be reported, but none is reported twice.
+    template<typename Func>
+    void range_scan(const K& low, const K& high, Func f) const {
+        EpochGuard guard;
+        Node* node = lower_bound(low);
+        while(node && comp(node->key, high)) {
+            std::uintptr_t succ = node->next[0].load(std::memory_order_acquire);
+            if(!is_marked(succ)) {
+                f(node->key, node->value);
+            }
+            node = get_ptr(succ);
+        }
+    }
+
+    template<typename Func>
+    void for_each(Func f) const {
+        EpochGuard guard;
+        Node* node = get_ptr(head[0].load(std::memory_order_acquire));
+        while(node) {
+            std::uintptr_t succ = node->next[0].load(std::memory_order_acquire);
+            if(!is_marked(succ)) {
+                f(node->key, node->value);
+            }
+            node = get_ptr(succ);
+        }
+    }
+
+    // exact when quiescent, approximate under concurrent updates
+    std::size_t size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    static constexpr std::uintptr_t MARK = 1;
+
+    static bool is_marked(std::uintptr_t raw) {
+        return raw & MARK;
+    }
+
+    static Node* get_ptr(std::uintptr_t raw) {
+        return reinterpret_cast<Node*>(raw & ~MARK);
+    }
+
+    static std::uintptr_t to_raw(Node* node) {
+        return reinterpret_cast<std::uintptr_t>(node);
+    }
+
+    // the head has no key, a null pred stands for it
+    std::atomic<std::uintptr_t>& link(Node* pred, int level) const {
+        return pred ? pred->next[level] : head[level];
+    }
+
+    bool less(Node* node, const K& key) const {
+        return comp(node->key, key);
+    }
+
+    // fills preds/succs around key on every level and unlinks marked
+    // nodes on the way, restarts from the head when a pred changed
+    bool find(const K& key, Node** preds, Node** succs) {
+    retry:
+        Node* pred = nullptr;
+        for(int level = MAX_LEVEL - 1; level >= 0; level--) {
+            Node* curr = get_ptr(link(pred, level).load(std::memory_order_acquire));
+            while(curr) {
+                std::uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+                if(is_marked(succ)) {
+                    std::uintptr_t expect = to_raw(curr);
+                    if(!link(pred, level).compare_exchange_strong(expect, succ & ~MARK,
+                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        goto retry;
+                    }
+                    curr = get_ptr(succ);
+                } else if(less(curr, key)) {
+                    pred = curr;
+                    curr = get_ptr(succ);
+                } else {
+                    break;
+                }
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return succs[0] && !comp(key, succs[0]->key);
+    }
+
+    // first unmarked node with key >= key, read only
+    Node* lower_bound(const K& key) const {
+        Node* pred = nullptr;
+        Node* curr = nullptr;
+        for(int level = MAX_LEVEL - 1; level >= 0; level--) {
+            curr = get_ptr(link(pred, level).load(std::memory_order_acquire));
+            while(curr) {
+                std::uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+                if(is_marked(succ)) {
+                    curr = get_ptr(succ);
+                } else if(less(curr, key)) {
+                    pred = curr;
+                    curr = get_ptr(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        return curr;
+    }
+
+    Node* search(const K& key) const {
+        Node* node = lower_bound(key);
+        if(node && !comp(key, node->key)) {
+            return node;
+        }
+        return nullptr;
+    }
+
+    void release(Node* node) {
+        if(node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            EpochManager::instance().retire(node);
+        }
+    }
+
+    static int random_level() {
+        thread_local std::minstd_rand engine(std::random_device{}());
+        // p = 1/2 per level
+        std::uint32_t bits = (std::uint32_t)engine();
+        int level = 1;
+        while((bits & 1) && level < MAX_LEVEL) {
+            level++;
+            bits >>= 1;
+        }
+        return level;
+    }
+
+    mutable std::atomic<std::uintptr_t> head[MAX_LEVEL];
+    Compare comp;
+    std::atomic<std::size_t> count;
+};
+
+// ordered set on top of the map
+template<typename K, typename Compare=std::less<K> >
+using LockFreeOrderedSet = LockFreeSkipList<K, std::monostate, Compare>;
+
+#endif
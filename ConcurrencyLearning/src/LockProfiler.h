@@ -0,0 +1,297 @@
+#ifndef LOCKPROFILER_H
+#define LOCKPROFILER_H
+
+// lock contention profiling.
+// containers take their lock type as a template parameter, pass
+// ProfiledMutex<M> to instrument them, e.g.
+//   FineGrainedLockQueue<int, ProfiledMutex<std::mutex> >
+// every lock reports into the site it was named with name_lock_site()
+// (the containers name their own locks, e.g. "FineGrainedLockQueue.head"),
+// and LockProfiler::instance().report() prints all sites.
+//
+// profiling only exists when LOCK_PROFILING is defined, otherwise
+// ProfiledMutex<M> is M itself and name_lock_site() is an empty inline,
+// so normal builds carry no trace of it.
+//
+// naming looks the site up under the profiler's lock, locks created on a
+// hot path resolve their site once and attach to it directly:
+//   static LockSiteStats* const site = lock_site("ThreadSafeList.node");
+//   name_lock_site(node->mut, site);
+
+#ifdef LOCK_PROFILING
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+// log2 histogram of nanoseconds, bucket b counts values in [2^b, 2^(b+1))
+class LockHistogram {
+public:
+    static constexpr int NUM_BUCKETS = 40;
+
+    LockHistogram() {
+        reset();
+    }
+
+    void record(std::uint64_t ns) {
+        int bucket = 0;
+        while(ns > 1 && bucket < NUM_BUCKETS - 1) {
+            ns >>= 1;
+            bucket++;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const {
+        std::uint64_t total = 0;
+        for(int i = 0; i < NUM_BUCKETS; i++) {
+            total += buckets[i].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // upper bound in ns of the bucket holding the given percentile
+    std::uint64_t percentile(double p) const {
+        std::uint64_t total = count();
+        if(total == 0) {
+            return 0;
+        }
+        std::uint64_t target = (std::uint64_t)(p / 100.0 * total);
+        std::uint64_t seen = 0;
+        for(int i = 0; i < NUM_BUCKETS; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if(seen > target) {
+                return 2ull << i;
+            }
+        }
+        return 2ull << (NUM_BUCKETS - 1);
+    }
+
+    void reset() {
+        for(int i = 0; i < NUM_BUCKETS; i++) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<std::uint64_t> buckets[NUM_BUCKETS];
+};
+
+struct LockSiteStats {
+    LockSiteStats() {
+        reset();
+    }
+
+    void reset() {
+        acquisitions.store(0, std::memory_order_relaxed);
+        shared_acquisitions.store(0, std::memory_order_relaxed);
+        contended.store(0, std::memory_order_relaxed);
+        wait_ns.reset();
+        hold_ns.reset();
+    }
+
+    std::atomic<std::uint64_t> acquisitions;
+    std::atomic<std::uint64_t> shared_acquisitions;
+    // acquisitions whose first try failed
+    std::atomic<std::uint64_t> contended;
+    // only contended acquisitions wait
+    LockHistogram wait_ns;
+    // exclusive holds only, shared holders are not tracked per thread
+    LockHistogram hold_ns;
+};
+
+class LockProfiler {
+public:
+    static LockProfiler& instance() {
+        static LockProfiler profiler;
+        return profiler;
+    }
+
+    // stats live as long as the program, locks keep raw pointers to them
+    LockSiteStats* site(const std::string& name) {
+        std::lock_guard<std::mutex> lk(mut);
+        std::unique_ptr<LockSiteStats>& stats = sites[name];
+        if(!stats) {
+            stats.reset(new LockSiteStats);
+        }
+        return stats.get();
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lk(mut);
+        for(auto&& kv : sites) {
+            kv.second->reset();
+        }
+    }
+
+    void report(std::ostream& os) {
+        std::lock_guard<std::mutex> lk(mut);
+        for(auto&& kv : sites) {
+            const LockSiteStats& stats = *kv.second;
+            std::uint64_t acquisitions = stats.acquisitions.load() + stats.shared_acquisitions.load();
+            if(acquisitions == 0) {
+                continue;
+            }
+            std::uint64_t contended = stats.contended.load();
+            os << kv.first
+                << ": acquisitions " << acquisitions
+                << " (shared " << stats.shared_acquisitions.load() << ")"
+                << ", contended " << contended
+                << " (" << 100.0 * contended / acquisitions << "%)"
+                << ", wait p50/p99 " << stats.wait_ns.percentile(50) << "/" << stats.wait_ns.percentile(99) << "ns"
+                << ", hold p50/p99 " << stats.hold_ns.percentile(50) << "/" << stats.hold_ns.percentile(99) << "ns"
+                << std::endl;
+        }
+    }
+
+private:
+    LockProfiler() {
+
+    }
+
+    std::mutex mut;
+    std::map<std::string, std::unique_ptr<LockSiteStats> > sites;
+};
+
+template<typename Mutex>
+class ProfiledMutex {
+public:
+    ProfiledMutex():
+    stats(unnamed_site()) {
+
+    }
+
+    void set_site(const char* name) {
+        stats = LockProfiler::instance().site(name);
+    }
+
+    void set_site(LockSiteStats* site) {
+        stats = site;
+    }
+
+    void lock() {
+        if(!mut.try_lock()) {
+            stats->contended.fetch_add(1, std::memory_order_relaxed);
+            std::uint64_t start = now_ns();
+            mut.lock();
+            stats->wait_ns.record(now_ns() - start);
+        }
+        on_acquired();
+    }
+
+    bool try_lock() {
+        if(!mut.try_lock()) {
+            return false;
+        }
+        on_acquired();
+        return true;
+    }
+
+    void unlock() {
+        stats->hold_ns.record(now_ns() - acquired_at);
+        mut.unlock();
+    }
+
+    // shared mode only exists when Mutex has it, so LockTraits still
+    // detects exclusive only locks through the wrapper
+    template<typename M = Mutex>
+    auto lock_shared() -> decltype(std::declval<M&>().lock_shared()) {
+        if(!mut.try_lock_shared()) {
+            stats->contended.fetch_add(1, std::memory_order_relaxed);
+            std::uint64_t start = now_ns();
+            mut.lock_shared();
+            stats->wait_ns.record(now_ns() - start);
+        }
+        stats->shared_acquisitions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template<typename M = Mutex>
+    auto try_lock_shared() -> decltype(std::declval<M&>().try_lock_shared()) {
+        if(!mut.try_lock_shared()) {
+            return false;
+        }
+        stats->shared_acquisitions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    template<typename M = Mutex>
+    auto unlock_shared() -> decltype(std::declval<M&>().unlock_shared()) {
+        mut.unlock_shared();
+    }
+
+private:
+    static LockSiteStats* unnamed_site() {
+        static LockSiteStats* unnamed = LockProfiler::instance().site("unnamed");
+        return unnamed;
+    }
+
+    static std::uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void on_acquired() {
+        stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        acquired_at = now_ns();
+    }
+
+    Mutex mut;
+    LockSiteStats* stats;
+    // written by the exclusive holder only
+    std::uint64_t acquired_at;
+};
+
+template<typename Mutex>
+inline void name_lock_site(Mutex&, const char*) {
+
+}
+
+template<typename Mutex>
+inline void name_lock_site(ProfiledMutex<Mutex>& mut, const char* name) {
+    mut.set_site(name);
+}
+
+inline LockSiteStats* lock_site(const char* name) {
+    return LockProfiler::instance().site(name);
+}
+
+template<typename Mutex>
+inline void name_lock_site(Mutex&, LockSiteStats*) {
+
+}
+
+template<typename Mutex>
+inline void name_lock_site(ProfiledMutex<Mutex>& mut, LockSiteStats* site) {
+    mut.set_site(site);
+}
+
+#else
+
+struct LockSiteStats;
+
+template<typename Mutex>
+using ProfiledMutex = Mutex;
+
+template<typename Mutex>
+inline void name_lock_site(Mutex&, const char*) {
+
+}
+
+inline LockSiteStats* lock_site(const char*) {
+    return nullptr;
+}
+
+template<typename Mutex>
+inline void name_lock_site(Mutex&, LockSiteStats*) {
+
+}
+
+#endif
+
+#endif
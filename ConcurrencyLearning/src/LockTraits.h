@@ -0,0 +1,45 @@
+#ifndef LOCKTRAITS_H
+#define LOCKTRAITS_H
+
+#include <type_traits>
+#include <utility>
+
+// detect whether a lock type offers lock_shared/unlock_shared
+template<typename Mutex, typename = void>
+struct IsSharedLockable: std::false_type {};
+
+template<typename Mutex>
+struct IsSharedLockable<Mutex, std::void_t<
+    decltype(std::declval<Mutex&>().lock_shared()),
+    decltype(std::declval<Mutex&>().unlock_shared())> >: std::true_type {};
+
+// takes a shared lock when the mutex supports it,
+// otherwise falls back to an exclusive lock
+template<typename Mutex>
+class ReadLockGuard {
+public:
+    explicit ReadLockGuard(Mutex& mut_):
+    mut(mut_) {
+        if constexpr (IsSharedLockable<Mutex>::value) {
+            mut.lock_shared();
+        } else {
+            mut.lock();
+        }
+    }
+
+    ~ReadLockGuard() {
+        if constexpr (IsSharedLockable<Mutex>::value) {
+            mut.unlock_shared();
+        } else {
+            mut.unlock();
+        }
+    }
+
+    ReadLockGuard(const ReadLockGuard&) = delete;
+    ReadLockGuard& operator=(const ReadLockGuard&) = delete;
+
+private:
+    Mutex& mut;
+};
+
+#endif
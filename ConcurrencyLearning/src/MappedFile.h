@@ -0,0 +1,97 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+// posix only, like InputSystem.h is windows only
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstddef>
+#include <string>
+
+// owns a read-only or read-write mapping of a whole file
+class MappedFile {
+public:
+	MappedFile():
+	fd(-1), data(nullptr), length(0) {
+
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open_read(const std::string& path) {
+		close();
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			close();
+			return false;
+		}
+		return map((std::size_t)st.st_size, PROT_READ);
+	}
+
+	bool create(const std::string& path, std::size_t size) {
+		close();
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			return false;
+		}
+		if (ftruncate(fd, (off_t)size) != 0) {
+			close();
+			return false;
+		}
+		return map(size, PROT_READ | PROT_WRITE);
+	}
+
+	// flush dirty pages, only meaningful for created files
+	bool sync() {
+		return data && msync(data, length, MS_SYNC) == 0;
+	}
+
+	void close() {
+		if (data) {
+			munmap(data, length);
+			data = nullptr;
+		}
+		if (fd >= 0) {
+			::close(fd);
+			fd = -1;
+		}
+		length = 0;
+	}
+
+	char* get() const {
+		return data;
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+
+private:
+	bool map(std::size_t size, int prot) {
+		void* addr = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			close();
+			return false;
+		}
+		data = (char*)addr;
+		length = size;
+		return true;
+	}
+
+	int fd;
+	char* data;
+	std::size_t length;
+};
+
+#endif
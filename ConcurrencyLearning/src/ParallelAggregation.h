@@ -0,0 +1,147 @@
+#ifndef PARALLELAGGREGATION_H
+#define PARALLELAGGREGATION_H
+
+#include "ThreadPool.h"
+#include "Partitioner.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// aggregation without shared locks: every worker builds its own partial
+// result, the partials are merged once at the end.
+
+// counts[b] = number of elements with bin_of(element) == b, elements whose
+// bin is num_bins or more are dropped. for small dense key ranges, every
+// worker counts into its own array and the arrays are summed bin-wise in
+// parallel.
+template<typename Iterator, typename BinOf, typename Partitioner = AutoPartitioner>
+std::vector<std::size_t> parallel_histogram(Iterator first, Iterator last, std::size_t num_bins, BinOf bin_of,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    // separate allocations, workers never write to the same cache line
+    std::vector<std::vector<std::size_t> > partials(pool.size() + 1);
+    parallel_detail::for_each_chunk(length, [first, num_bins, &bin_of, &partials](int worker, std::size_t begin, std::size_t end) {
+        std::vector<std::size_t>& counts = partials[worker];
+        if(counts.empty()) {
+            counts.resize(num_bins, 0);
+        }
+        Iterator it = std::next(first, begin);
+        for(; begin < end; ++begin, ++it) {
+            std::size_t bin = bin_of(*it);
+            if(bin < num_bins) {
+                counts[bin]++;
+            }
+        }
+    }, partitioner, pool);
+
+    std::vector<std::size_t> counts(num_bins, 0);
+    parallel_for_range(num_bins, [&counts, &partials](std::size_t begin, std::size_t end) {
+        for(auto&& partial : partials) {
+            if(partial.empty()) {
+                continue;
+            }
+            for(std::size_t bin = begin; bin < end; bin++) {
+                counts[bin] += partial[bin];
+            }
+        }
+    }, AutoPartitioner(), pool);
+    return counts;
+}
+
+namespace parallel_detail {
+
+// partials are split by the top bits of the mixed hash, so the merge of
+// high cardinality keys runs one radix partition per task
+constexpr int GROUP_RADIX_BITS = 6;
+constexpr std::size_t GROUP_PARTITIONS = std::size_t(1) << GROUP_RADIX_BITS;
+
+inline std::size_t group_partition(std::size_t hash) {
+    // identity hashes of small ints would all land in partition 0
+    std::uint64_t mixed = (std::uint64_t)hash * 0x9E3779B97F4A7C15ull;
+    return (std::size_t)(mixed >> (64 - GROUP_RADIX_BITS));
+}
+
+}
+
+// result[k] = value_of(x0) op value_of(x1) op ... over the elements with
+// key_of(x) == k, in an unspecified order, so op must be associative and
+// commutative. every worker reduces into its own radix partitioned hash
+// maps, partition p of every worker is then merged by one task.
+template<typename Iterator, typename KeyOf, typename ValueOf, typename ReduceOp,
+    typename Hash = std::hash<std::decay_t<std::invoke_result_t<KeyOf&, typename std::iterator_traits<Iterator>::reference> > >,
+    typename Partitioner = AutoPartitioner>
+auto parallel_group_reduce(Iterator first, Iterator last, KeyOf key_of, ValueOf value_of, ReduceOp op,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    using Reference = typename std::iterator_traits<Iterator>::reference;
+    using Key = std::decay_t<std::invoke_result_t<KeyOf&, Reference> >;
+    using Value = std::decay_t<std::invoke_result_t<ValueOf&, Reference> >;
+    using Map = std::unordered_map<Key, Value, Hash>;
+    using parallel_detail::GROUP_PARTITIONS;
+
+    auto reduce_into = [&op](Map& map, Key key, Value value) {
+        auto result = map.try_emplace(std::move(key), value);
+        if(!result.second) {
+            result.first->second = op(std::move(result.first->second), std::move(value));
+        }
+    };
+
+    std::size_t length = std::distance(first, last);
+    Hash hash;
+    // partials[worker][partition]
+    std::vector<std::vector<Map> > partials(pool.size() + 1);
+    parallel_detail::for_each_chunk(length,
+        [first, &key_of, &value_of, &hash, &reduce_into, &partials](int worker, std::size_t begin, std::size_t end) {
+            std::vector<Map>& maps = partials[worker];
+            if(maps.empty()) {
+                maps.resize(GROUP_PARTITIONS);
+            }
+            Iterator it = std::next(first, begin);
+            for(; begin < end; ++begin, ++it) {
+                Key key = key_of(*it);
+                std::size_t partition = parallel_detail::group_partition(hash(key));
+                reduce_into(maps[partition], std::move(key), value_of(*it));
+            }
+        }, partitioner, pool);
+
+    // the largest worker map of a partition takes in the others
+    std::vector<Map> merged(GROUP_PARTITIONS);
+    parallel_detail::run_chunks(GROUP_PARTITIONS, 1, [&reduce_into, &partials, &merged](int, std::size_t partition, std::size_t) {
+        Map* target = nullptr;
+        for(auto&& maps : partials) {
+            if(!maps.empty() && (!target || maps[partition].size() > target->size())) {
+                target = &maps[partition];
+            }
+        }
+        if(!target) {
+            return;
+        }
+        for(auto&& maps : partials) {
+            if(maps.empty() || &maps[partition] == target) {
+                continue;
+            }
+            for(auto&& kv : maps[partition]) {
+                reduce_into(*target, kv.first, std::move(kv.second));
+            }
+            Map().swap(maps[partition]);
+        }
+        merged[partition].swap(*target);
+    }, pool);
+
+    // partitions have disjoint keys, splicing their nodes is cheap
+    std::size_t total = 0;
+    for(auto&& map : merged) {
+        total += map.size();
+    }
+    Map result;
+    result.reserve(total);
+    for(auto&& map : merged) {
+        result.merge(map);
+    }
+    return result;
+}
+
+#endif
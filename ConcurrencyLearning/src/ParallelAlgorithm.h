@@ -2,220 +2,861 @@
 #define PARALLELALGORITHM_H
 
 #include "ThreadPool.h"
+#include "Partitioner.h"
 #include "JoinerThreads.h"
+#include "CacheLine.h"
+#include "SimdKernels.h"
 #include <algorithm>
 #include <thread>
 #include <future>
 #include <atomic>
 #include <numeric>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <random>
+#include <vector>
+
+namespace parallel_detail {
 
 template<typename Iterator, typename Func>
-void async_for_each(Iterator first, Iterator last, Func f) {
-    int length = std::distance(first, last);
+void async_for_each(Iterator first, Iterator last, Func f, std::size_t grain, ThreadPool& pool) {
+    std::size_t length = std::distance(first, last);
     if(!length) {
         return;
     }
 
-    int min_per_thread = 25;
-    if(length < 2 * min_per_thread) {
+    if(length <= grain) {
         std::for_each(first, last, f);
     } else {
-        Iterator mid_it = first + length / 2;
-        std::future<void> first_half = std::async(
-            &async_for_each<Iterator, Func>, 
-            first, 
-            mid_it, 
-            f
+        Iterator mid_it = std::next(first, length / 2);
+        std::future<void> first_half = pool.submit(
+            [=, &pool]() {
+                async_for_each(first, mid_it, f, grain, pool);
+            }
         );
-        async_for_each(mid_it, last, f);
+        // f may refer to the caller's frame, the first half must be done
+        // before an exception of the second leaves it
+        try {
+            async_for_each(mid_it, last, f, grain, pool);
+        } catch(...) {
+            pool.wait(first_half);
+            throw;
+        }
+        pool.wait(first_half);
         first_half.get();
     }
 }
 
-template<typename Iterator, typename Func>
-void parallel_for_each(Iterator first, Iterator last, Func f) {
-    int length = std::distance(first, last);
-    if(!length) return;
+}
 
-    int min_per_thread = 25;
-    int max_threads = (length + min_per_thread - 1) / min_per_thread;
+// the algorithms below run on a ThreadPool, the shared default pool unless
+// one is given. the partitioner sets the chunk size, AutoPartitioner makes
+// a few chunks per worker, SimplePartitioner(grain) a fixed grain.
+
+// recursive halving, the first half of every split becomes a pool task
+template<typename Iterator, typename Func, typename Partitioner = AutoPartitioner>
+void async_for_each(Iterator first, Iterator last, Func f,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    parallel_detail::async_for_each(first, last, f, resolve_grain_size(partitioner, length, pool), pool);
+}
+
+template<typename Iterator, typename Func, typename Partitioner = AutoPartitioner>
+void parallel_for_each(Iterator first, Iterator last, Func f,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    parallel_for_range(length, [first, &f](std::size_t begin, std::size_t end) {
+        std::for_each(std::next(first, begin), std::next(first, end), f);
+    }, partitioner, pool);
+}
 
-    int num_hardware_threads = std::thread::hardware_concurrency();
+namespace parallel_detail {
 
-    int num_threads = std::min(num_hardware_threads, max_threads);
+// contiguous int / float / double ranges searched or summed for their own
+// element type go through the SimdKernels.h kernels
+template<typename Iterator, typename T>
+struct UseSimdKernels: std::integral_constant<bool, IsContiguousIterator<Iterator>::value &&
+    IsSimdElement<T>::value && std::is_same<typename std::iterator_traits<Iterator>::value_type, T>::value> {
+
+};
 
-    int block_size = length / num_threads;
+}
 
-    std::vector<std::future<void> > futures(num_threads - 1);
-    
-    Iterator block_start = first;
-    for(int i = 0; i < num_threads - 1; i++) {
-        Iterator block_end = block_start;
-        std::advance(block_end, block_size);
-        std::packaged_task<void(void)> task(
-            [=]() {
-                std::for_each(block_start, block_end, f);
+// returns any match, chunks not started yet are skipped once one is found
+template<typename Iterator, typename MatchType, typename Partitioner = AutoPartitioner>
+Iterator parallel_find(Iterator first, Iterator last, MatchType match,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    std::atomic<std::size_t> found(length);
+    if constexpr(parallel_detail::UseSimdKernels<Iterator, MatchType>::value) {
+        // the vector loop checks for a match once per chunk only
+        const MatchType* data = length ? &*first : nullptr;
+        parallel_for_range(length, [data, length, &match, &found](std::size_t begin, std::size_t end) {
+            if(found.load(std::memory_order_relaxed) != length) {
+                return;
             }
-        );
-        futures[i] = task.get_future();
-        std::thread(std::move(task)).detach();
-        block_start = block_end;
+            std::size_t i = begin + simd_find(data + begin, end - begin, match);
+            if(i != end) {
+                std::size_t expect = length;
+                found.compare_exchange_strong(expect, i);
+            }
+        }, partitioner, pool);
+    } else {
+        parallel_for_range(length, [first, length, &match, &found](std::size_t begin, std::size_t end) {
+            Iterator it = std::next(first, begin);
+            for(std::size_t i = begin; i < end && found.load(std::memory_order_relaxed) == length; ++i, ++it) {
+                if(*it == match) {
+                    std::size_t expect = length;
+                    found.compare_exchange_strong(expect, i);
+                    return;
+                }
+            }
+        }, partitioner, pool);
     }
-    std::for_each(block_start, last, f);
-    for(int i = 0; i < num_threads - 1; i++) {
-        futures[i].get();
+
+    if(found.load() == length) {
+        return last;
     }
+    return std::next(first, found.load());
 }
 
+namespace parallel_detail {
+
+// index of the first match in [0, length), length if there is none.
+// match_chunk(begin, end) returns the first match in [begin, end) or end.
+// chunks are claimed in index order, a match only cancels the chunks
+// behind it, so the result is the first match whatever the scheduling.
+// with any set every chunk not started yet is cancelled by any match.
+template<typename MatchChunk, typename Partitioner>
+std::size_t find_index(std::size_t length, MatchChunk match_chunk, bool any,
+    const Partitioner& partitioner, ThreadPool& pool) {
+    std::atomic<std::size_t> best(length);
+    parallel_for_range(length, [length, any, &match_chunk, &best](std::size_t begin, std::size_t end) {
+        std::size_t limit = best.load(std::memory_order_relaxed);
+        if(any ? limit != length : begin >= limit) {
+            return;
+        }
+        end = std::min(end, limit);
+        std::size_t i = match_chunk(begin, end);
+        std::size_t current = best.load(std::memory_order_relaxed);
+        while(i < end && i < current && !best.compare_exchange_weak(current, i));
+    }, partitioner, pool);
+    return best.load();
+}
 
-template<typename Iterator, typename MatchType> 
-Iterator parallel_find(Iterator first, Iterator last, MatchType match) {
-    auto find_element = [](Iterator begin, Iterator end, MatchType match,
-            std::promise<Iterator>& result, std::atomic<bool>& done_flag) {
-        try {
-            for(; (begin != end) && !done_flag.load(); ++begin) {
-                if(*begin == match) {
-                    result.set_value(begin);
-                    done_flag.store(true);
-                    return;    
-                }
+template<typename Iterator, typename Predicate, typename Partitioner>
+std::size_t find_if_index(Iterator first, Iterator last, Predicate& pred, bool any,
+    const Partitioner& partitioner, ThreadPool& pool) {
+    return find_index(std::distance(first, last), [first, &pred](std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        for(; begin < end; ++begin, ++it) {
+            if(pred(*it)) {
+                break;
             }
-        } catch(...) {
-            // result has been set
-            done_flag.store(true);
         }
+        return begin;
+    }, any, partitioner, pool);
+}
+
+}
+
+// the first element with pred(element), like std::find_if
+template<typename Iterator, typename Predicate, typename Partitioner = SearchPartitioner>
+Iterator parallel_find_if(Iterator first, Iterator last, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    return std::next(first, parallel_detail::find_if_index(first, last, pred, false, partitioner, pool));
+}
+
+// the first element equal to value, like std::find, unlike parallel_find
+// which returns whichever match it sees first
+template<typename Iterator, typename T, typename Partitioner = SearchPartitioner>
+Iterator parallel_find_first(Iterator first, Iterator last, const T& value,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    if constexpr(parallel_detail::UseSimdKernels<Iterator, T>::value) {
+        const T* data = length ? &*first : nullptr;
+        return std::next(first, parallel_detail::find_index(length, [data, &value](std::size_t begin, std::size_t end) {
+            return begin + simd_find(data + begin, end - begin, value);
+        }, false, partitioner, pool));
+    } else {
+        auto pred = [&value](const auto& element) {
+            return element == value;
+        };
+        return std::next(first, parallel_detail::find_if_index(first, last, pred, false, partitioner, pool));
+    }
+}
+
+template<typename Iterator, typename Predicate, typename Partitioner = SearchPartitioner>
+bool parallel_any_of(Iterator first, Iterator last, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    return parallel_detail::find_if_index(first, last, pred, true, partitioner, pool) != (std::size_t)std::distance(first, last);
+}
+
+template<typename Iterator, typename Predicate, typename Partitioner = SearchPartitioner>
+bool parallel_none_of(Iterator first, Iterator last, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    return !parallel_any_of(first, last, pred, partitioner, pool);
+}
+
+template<typename Iterator, typename Predicate, typename Partitioner = SearchPartitioner>
+bool parallel_all_of(Iterator first, Iterator last, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    return !parallel_any_of(first, last, [&pred](const auto& element) {
+        return !pred(element);
+    }, partitioner, pool);
+}
+
+// UNORDERED: every worker folds the chunks it claims into its own
+//   partial, op must be associative and commutative (like std::reduce).
+// DETERMINISTIC: one partial per chunk, combined left to right, op only
+//   needs to be associative. chunk bounds do not depend on the pool size
+//   or on scheduling, so floating point results are reproducible.
+enum class ReduceMode {
+    UNORDERED,
+    DETERMINISTIC
+};
+
+namespace parallel_detail {
+
+// chunking of a DETERMINISTIC reduction assumes this many workers
+constexpr int NOMINAL_WORKERS = 16;
+
+// chunk bounds that depend on length only, an adaptive grain changes
+// with the measured cost so it is left out
+template<typename Partitioner>
+std::size_t deterministic_grain(const Partitioner& partitioner, std::size_t length) {
+    if constexpr(std::is_same<Partitioner, AdaptivePartitioner>::value) {
+        return AutoPartitioner().grain_size(length, NOMINAL_WORKERS);
+    } else {
+        return std::max<std::size_t>(1, partitioner.grain_size(length, NOMINAL_WORKERS));
+    }
+}
+
+template<typename Iterator, typename T, typename ReduceOp, typename TransformOp, typename Partitioner>
+T transform_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op, TransformOp transform_op,
+    ReduceMode mode, const Partitioner& partitioner, ThreadPool& pool) {
+    std::size_t length = std::distance(first, last);
+    if(!length) {
+        return init;
+    }
+
+    // a chunk is seeded with its first element, op needs no identity
+    auto fold = [first, &reduce_op, &transform_op](std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        T partial = transform_op(*it);
+        for(++it, ++begin; begin < end; ++begin, ++it) {
+            partial = reduce_op(std::move(partial), transform_op(*it));
+        }
+        return partial;
     };
-    
-    int length = std::distance(first, last);
-    if(!length)return last;
 
-    int min_per_thread = 25;
-    int max_threads = (length + min_per_thread - 1) / min_per_thread;
+    // partials sit on their own cache lines, writers do not false share
+    std::vector<CacheAligned<std::optional<T> > > partials;
+    if(mode == ReduceMode::DETERMINISTIC) {
+        std::size_t grain = deterministic_grain(partitioner, length);
+        partials.resize((length + grain - 1) / grain);
+        run_chunks(length, grain, [grain, &fold, &partials](int, std::size_t begin, std::size_t end) {
+            partials[begin / grain].value.emplace(fold(begin, end));
+        }, pool);
+    } else {
+        partials.resize(pool.size() + 1);
+        for_each_chunk(length,
+            [&reduce_op, &fold, &partials](int worker, std::size_t begin, std::size_t end) {
+                std::optional<T>& partial = partials[worker].value;
+                if(partial) {
+                    partial.emplace(reduce_op(std::move(*partial), fold(begin, end)));
+                } else {
+                    partial.emplace(fold(begin, end));
+                }
+            }, partitioner, pool);
+    }
 
-    int num_hardware_threads = std::thread::hardware_concurrency();
+    T result = std::move(init);
+    for(auto&& partial : partials) {
+        if(partial.value) {
+            result = reduce_op(std::move(result), std::move(*partial.value));
+        }
+    }
+    return result;
+}
 
-    int num_threads = std::min(num_hardware_threads, max_threads);
+}
 
-    int block_size = length / num_threads;
+// init op x0 op x1 ... for any associative op, see ReduceMode
+template<typename Iterator, typename T, typename ReduceOp, typename Partitioner = AutoPartitioner>
+T parallel_reduce(Iterator first, Iterator last, T init, ReduceOp op,
+    ReduceMode mode = ReduceMode::UNORDERED, const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    using Value = typename std::iterator_traits<Iterator>::value_type;
+    return parallel_detail::transform_reduce(first, last, std::move(init), op,
+        [](const Value& value) -> const Value& {
+            return value;
+        }, mode, partitioner, pool);
+}
 
-    std::promise<Iterator> result;
-    std::atomic<bool> done_flag(false);
-    std::vector<std::thread> threads(num_threads - 1);
+// init reduce_op transform_op(x0) reduce_op transform_op(x1) ...
+template<typename Iterator, typename T, typename ReduceOp, typename TransformOp, typename Partitioner = AutoPartitioner>
+T parallel_transform_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op, TransformOp transform_op,
+    ReduceMode mode = ReduceMode::UNORDERED, const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    return parallel_detail::transform_reduce(first, last, std::move(init), reduce_op, transform_op,
+        mode, partitioner, pool);
+}
 
-    {
-        JoinThreads joiner(threads);
-        Iterator block_start = first;
-        for(int i = 0; i < num_threads - 1; i++) {
-            Iterator block_end = block_start;
-            std::advance(block_end, block_size);
-            threads[i] = std::thread(find_element, block_start, block_end, match, std::ref(result), std::ref(done_flag));
-            block_start = block_end;
+// a left fold like std::accumulate, partial sums are added in order.
+// int / float / double arrays are summed with vector kernels per chunk
+template<typename Iterator, typename T, typename Partitioner = AutoPartitioner>
+T parallel_accumulate(Iterator first, Iterator last, T init,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    if constexpr(parallel_detail::UseSimdKernels<Iterator, T>::value) {
+        std::size_t length = std::distance(first, last);
+        if(!length) {
+            return init;
+        }
+        const T* data = &*first;
+        std::size_t grain = parallel_detail::deterministic_grain(partitioner, length);
+        std::vector<CacheAligned<T> > partials((length + grain - 1) / grain);
+        parallel_detail::run_chunks(length, grain, [data, grain, &partials](int, std::size_t begin, std::size_t end) {
+            partials[begin / grain].value = simd_sum(data + begin, end - begin);
+        }, pool);
+        for(auto&& partial : partials) {
+            init = simd_detail::add(init, partial.value);
         }
-        find_element(block_start, last, match, std::ref(result), std::ref(done_flag));
+        return init;
+    }
+    return parallel_reduce(first, last, std::move(init), [](T lhs, const T& rhs) {
+        return lhs + rhs;
+    }, ReduceMode::DETERMINISTIC, partitioner, pool);
+}
+
+namespace parallel_detail {
+
+// two pass block scan: reduce every chunk, scan the chunk sums on the
+// calling thread, then rescan every chunk from its carry. each chunk reads
+// an element before writing its output, so d_first may equal first.
+template<typename Iterator, typename OutputIterator, typename T, typename BinaryOp, typename Partitioner>
+OutputIterator scan(Iterator first, Iterator last, OutputIterator d_first, std::optional<T> init,
+    BinaryOp op, bool inclusive, const Partitioner& partitioner, ThreadPool& pool) {
+    std::size_t length = std::distance(first, last);
+    if(!length) {
+        return d_first;
     }
 
-    if(!done_flag.load()) {
-        return last;
+    std::size_t grain = resolve_grain_size(partitioner, length, pool);
+    std::size_t num_chunks = (length + grain - 1) / grain;
+    std::vector<CacheAligned<std::optional<T> > > carries(num_chunks);
+    if(num_chunks > 1) {
+        run_chunks((num_chunks - 1) * grain, grain, [first, grain, &op, &carries](int, std::size_t begin, std::size_t end) {
+            // the last chunk's sum is never needed
+            Iterator it = std::next(first, begin);
+            T sum = *it;
+            for(++it, ++begin; begin < end; ++begin, ++it) {
+                sum = op(std::move(sum), *it);
+            }
+            carries[end / grain].value.emplace(std::move(sum));
+        }, pool);
     }
-    return result.get_future().get();
+
+    // carries[k] holds the sum of chunk k - 1 and becomes
+    // init op the sums of all chunks before k
+    std::optional<T> carry = std::move(init);
+    for(std::size_t k = 0; k < num_chunks; k++) {
+        std::optional<T>& sum = carries[k].value;
+        if(sum) {
+            carry.emplace(carry ? op(std::move(*carry), std::move(*sum)) : std::move(*sum));
+        }
+        sum = carry;
+    }
+
+    run_chunks(length, grain, [first, d_first, grain, inclusive, &op, &carries](int, std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        OutputIterator out = std::next(d_first, begin);
+        std::optional<T>& carry = carries[begin / grain].value;
+        if(inclusive) {
+            T acc = carry ? op(std::move(*carry), *it) : T(*it);
+            *out = acc;
+            for(++it, ++out, ++begin; begin < end; ++begin, ++it, ++out) {
+                acc = op(std::move(acc), *it);
+                *out = acc;
+            }
+        } else {
+            T acc = std::move(*carry);
+            for(; begin < end; ++begin, ++it, ++out) {
+                T value = *it;
+                *out = acc;
+                acc = op(std::move(acc), std::move(value));
+            }
+        }
+    }, pool);
+    return std::next(d_first, length);
 }
 
-template<typename Iterator, typename T>
-T parallel_accumulate(Iterator first, Iterator last, T init) {
-    auto accumulate_block = [](Iterator first,Iterator last,T& result) {
-        result=std::accumulate(first,last,result);
+}
+
+// d_first[i] = x0 op x1 op ... op xi, op must be associative
+template<typename Iterator, typename OutputIterator, typename BinaryOp = std::plus<>,
+    typename Partitioner = AutoPartitioner>
+OutputIterator parallel_inclusive_scan(Iterator first, Iterator last, OutputIterator d_first,
+    BinaryOp op = BinaryOp(), const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    return parallel_detail::scan(first, last, d_first, std::optional<T>(), op, true, partitioner, pool);
+}
+
+// d_first[i] = init op x0 op ... op x(i-1), op must be associative
+template<typename Iterator, typename OutputIterator, typename T, typename BinaryOp = std::plus<>,
+    typename Partitioner = AutoPartitioner>
+OutputIterator parallel_exclusive_scan(Iterator first, Iterator last, OutputIterator d_first, T init,
+    BinaryOp op = BinaryOp(), const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    return parallel_detail::scan(first, last, d_first, std::optional<T>(std::move(init)), op, false, partitioner, pool);
+}
+
+// d_first[i] = op(first[i]), d_first may equal first
+template<typename Iterator, typename OutputIterator, typename UnaryOp, typename Partitioner = AutoPartitioner,
+    typename = std::enable_if_t<std::is_invocable<UnaryOp&, typename std::iterator_traits<Iterator>::reference>::value> >
+OutputIterator parallel_transform(Iterator first, Iterator last, OutputIterator d_first, UnaryOp op,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    parallel_for_range(length, [first, d_first, &op](std::size_t begin, std::size_t end) {
+        std::transform(std::next(first, begin), std::next(first, end), std::next(d_first, begin), op);
+    }, partitioner, pool);
+    return std::next(d_first, length);
+}
+
+// d_first[i] = op(first1[i], first2[i])
+template<typename Iterator1, typename Iterator2, typename OutputIterator, typename BinaryOp,
+    typename Partitioner = AutoPartitioner,
+    typename = std::enable_if_t<std::is_invocable<BinaryOp&, typename std::iterator_traits<Iterator1>::reference,
+        typename std::iterator_traits<Iterator2>::reference>::value> >
+OutputIterator parallel_transform(Iterator1 first1, Iterator1 last1, Iterator2 first2, OutputIterator d_first,
+    BinaryOp op, const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first1, last1);
+    parallel_for_range(length, [first1, first2, d_first, &op](std::size_t begin, std::size_t end) {
+        std::transform(std::next(first1, begin), std::next(first1, end), std::next(first2, begin),
+            std::next(d_first, begin), op);
+    }, partitioner, pool);
+    return std::next(d_first, length);
+}
+
+namespace parallel_detail {
+
+// first pass of the compaction algorithms: pred is called once per element
+// and remembered in flags, returns the number of matches before every
+// chunk plus the total at the back. the second pass writes every chunk
+// at its offset, no two chunks write the same output.
+template<typename Iterator, typename Predicate>
+std::vector<std::size_t> flag_chunks(Iterator first, std::size_t length, std::size_t grain, Predicate& pred,
+    std::vector<unsigned char>& flags, ThreadPool& pool) {
+    std::size_t num_chunks = (length + grain - 1) / grain;
+    std::vector<std::size_t> offsets(num_chunks + 1, 0);
+    flags.resize(length);
+    run_chunks(length, grain, [first, grain, &pred, &flags, &offsets](int, std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        std::size_t count = 0;
+        for(std::size_t i = begin; i < end; ++i, ++it) {
+            flags[i] = pred(*it) ? 1 : 0;
+            count += flags[i];
+        }
+        offsets[begin / grain] = count;
+    }, pool);
+
+    std::size_t total = 0;
+    for(auto&& offset : offsets) {
+        std::size_t count = offset;
+        offset = total;
+        total += count;
+    }
+    return offsets;
+}
+
+}
+
+// copies the elements with pred(element) in order to d_first, which must
+// have room for them, returns the end of the output. like std::copy_if,
+// every chunk writes its own slice so there are no locks or push_backs
+template<typename Iterator, typename OutputIterator, typename Predicate, typename Partitioner = AutoPartitioner>
+OutputIterator parallel_copy_if(Iterator first, Iterator last, OutputIterator d_first, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    std::size_t length = std::distance(first, last);
+    if(!length) {
+        return d_first;
+    }
+    std::size_t grain = resolve_grain_size(partitioner, length, pool);
+    std::vector<unsigned char> flags;
+    std::vector<std::size_t> offsets = parallel_detail::flag_chunks(first, length, grain, pred, flags, pool);
+    parallel_detail::run_chunks(length, grain, [first, d_first, grain, &flags, &offsets](int, std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        OutputIterator out = std::next(d_first, offsets[begin / grain]);
+        for(std::size_t i = begin; i < end; ++i, ++it) {
+            if(flags[i]) {
+                *out = *it;
+                ++out;
+            }
+        }
+    }, pool);
+    return std::next(d_first, offsets.back());
+}
+
+// removes the elements with pred(element) keeping the order of the rest,
+// returns the new end. the kept elements go through a buffer, so the
+// element type must be default constructible and move assignable
+template<typename Iterator, typename Predicate, typename Partitioner = AutoPartitioner>
+Iterator parallel_remove_if(Iterator first, Iterator last, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    std::size_t length = std::distance(first, last);
+    if(!length) {
+        return last;
+    }
+    std::size_t grain = resolve_grain_size(partitioner, length, pool);
+    std::vector<unsigned char> flags;
+    auto keep = [&pred](const T& element) {
+        return !pred(element);
     };
+    std::vector<std::size_t> offsets = parallel_detail::flag_chunks(first, length, grain, keep, flags, pool);
+    std::size_t kept = offsets.back();
+    if(kept == length) {
+        return last;
+    }
 
-    int length=std::distance(first,last);
+    std::vector<T> buffer(kept);
+    parallel_detail::run_chunks(length, grain, [first, grain, &buffer, &flags, &offsets](int, std::size_t begin, std::size_t end) {
+        Iterator it = std::next(first, begin);
+        auto out = buffer.begin() + offsets[begin / grain];
+        for(std::size_t i = begin; i < end; ++i, ++it) {
+            if(flags[i]) {
+                *out++ = std::move(*it);
+            }
+        }
+    }, pool);
+    parallel_detail::run_chunks(kept, grain, [first, &buffer](int, std::size_t begin, std::size_t end) {
+        std::move(buffer.begin() + begin, buffer.begin() + end, std::next(first, begin));
+    }, pool);
+    return std::next(first, kept);
+}
 
-    if(!length)
-        return init;
+// moves the elements with pred(element) in front of the others, both
+// groups keep their order (like std::stable_partition), returns the first
+// element of the second group. goes through a buffer like remove_if
+template<typename Iterator, typename Predicate, typename Partitioner = AutoPartitioner>
+Iterator parallel_partition(Iterator first, Iterator last, Predicate pred,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    std::size_t length = std::distance(first, last);
+    if(!length) {
+        return last;
+    }
+    std::size_t grain = resolve_grain_size(partitioner, length, pool);
+    std::vector<unsigned char> flags;
+    std::vector<std::size_t> offsets = parallel_detail::flag_chunks(first, length, grain, pred, flags, pool);
+    std::size_t num_true = offsets.back();
+
+    std::vector<T> buffer(length);
+    parallel_detail::run_chunks(length, grain, [first, grain, num_true, &buffer, &flags, &offsets](int, std::size_t begin, std::size_t end) {
+        // elements before the chunk that go to the first group
+        std::size_t trues_before = offsets[begin / grain];
+        auto true_out = buffer.begin() + trues_before;
+        auto false_out = buffer.begin() + num_true + (begin - trues_before);
+        Iterator it = std::next(first, begin);
+        for(std::size_t i = begin; i < end; ++i, ++it) {
+            if(flags[i]) {
+                *true_out++ = std::move(*it);
+            } else {
+                *false_out++ = std::move(*it);
+            }
+        }
+    }, pool);
+    parallel_detail::run_chunks(length, grain, [first, &buffer](int, std::size_t begin, std::size_t end) {
+        std::move(buffer.begin() + begin, buffer.begin() + end, std::next(first, begin));
+    }, pool);
+    return std::next(first, num_true);
+}
+
+namespace parallel_detail {
+
+// number of elements of [a, a + m) among the first d outputs of a stable
+// merge of [a, a + m) and [b, b + n), equal elements of a go first
+template<typename Iterator1, typename Iterator2, typename Compare>
+std::size_t co_rank(std::size_t d, Iterator1 a, std::size_t m, Iterator2 b, std::size_t n, Compare& comp) {
+    std::size_t lo = d > n ? d - n : 0;
+    std::size_t hi = std::min(d, m);
+    while(lo < hi) {
+        std::size_t i = lo + (hi - lo) / 2;
+        std::size_t j = d - i;
+        // a[i] is output before b[j - 1], more of a belongs in front
+        if(j > 0 && !comp(b[j - 1], a[i])) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+// bottom up merge sort: sort grain sized runs in parallel, then merge
+// neighbouring runs in rounds. every round is split on the output with
+// co_rank, so a single big merge is parallel too and the depth stays
+// O(log n). runs ping-pong between the range and one buffer.
+template<typename RandomIt, typename Compare, typename RunSort, typename Partitioner>
+void merge_sort(RandomIt first, RandomIt last, Compare comp, RunSort run_sort,
+    const Partitioner& partitioner, ThreadPool& pool) {
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    std::size_t length = std::distance(first, last);
+    std::size_t grain = resolve_grain_size(partitioner, length, pool);
+    if(length <= grain) {
+        run_sort(first, last, comp);
+        return;
+    }
+
+    run_chunks(length, grain, [first, &comp, &run_sort](int, std::size_t begin, std::size_t end) {
+        run_sort(first + begin, first + end, comp);
+    }, pool);
+
+    std::vector<T> buffer(first, last);
+    bool in_buffer = false;
+    for(std::size_t width = grain; width < length; width *= 2) {
+        auto merge_round = [length, width, grain, &comp, &pool](auto src, auto dst) {
+            run_chunks(length, grain, [=, &comp](int, std::size_t begin, std::size_t end) {
+                // a piece of the output may span several pairs of runs
+                while(begin < end) {
+                    std::size_t pair_start = begin / (2 * width) * (2 * width);
+                    std::size_t mid = std::min(pair_start + width, length);
+                    std::size_t pair_end = std::min(pair_start + 2 * width, length);
+                    std::size_t piece_end = std::min(end, pair_end);
+                    auto a = src + pair_start;
+                    auto b = src + mid;
+                    std::size_t m = mid - pair_start, n = pair_end - mid;
+                    std::size_t i_begin = co_rank(begin - pair_start, a, m, b, n, comp);
+                    std::size_t i_end = co_rank(piece_end - pair_start, a, m, b, n, comp);
+                    std::size_t j_begin = begin - pair_start - i_begin;
+                    std::size_t j_end = piece_end - pair_start - i_end;
+                    std::merge(std::make_move_iterator(a + i_begin), std::make_move_iterator(a + i_end),
+                        std::make_move_iterator(b + j_begin), std::make_move_iterator(b + j_end),
+                        dst + begin, comp);
+                    begin = piece_end;
+                }
+            }, pool);
+        };
+        if(in_buffer) {
+            merge_round(buffer.begin(), first);
+        } else {
+            merge_round(first, buffer.begin());
+        }
+        in_buffer = !in_buffer;
+    }
+
+    if(in_buffer) {
+        run_chunks(length, grain, [first, &buffer](int, std::size_t begin, std::size_t end) {
+            std::move(buffer.begin() + begin, buffer.begin() + end, first + begin);
+        }, pool);
+    }
+}
 
-    int min_per_thread=25;
-    int max_threads=
-        (length+min_per_thread-1)/min_per_thread;
+template<typename Key>
+struct KeyCompare {
+    template<typename T>
+    bool operator()(const T& lhs, const T& rhs) const {
+        return key(lhs) < key(rhs);
+    }
 
-    int hardware_threads=
-        std::thread::hardware_concurrency();
+    Key key;
+};
 
-    int num_threads=
-        std::min(hardware_threads, max_threads);
+}
 
-    int block_size=length/num_threads;
+// parallel merge sort, the partitioner sets the size of the sorted runs
+template<typename RandomIt, typename Compare = std::less<>, typename Partitioner = AutoPartitioner>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp = Compare(),
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    parallel_detail::merge_sort(first, last, comp, [](RandomIt begin, RandomIt end, Compare& comp) {
+        std::sort(begin, end, comp);
+    }, partitioner, pool);
+}
 
-    std::vector<T> results(num_threads);
-    std::vector<std::thread>  threads(num_threads-1);
+// keeps the order of equal elements
+template<typename RandomIt, typename Compare = std::less<>, typename Partitioner = AutoPartitioner>
+void parallel_stable_sort(RandomIt first, RandomIt last, Compare comp = Compare(),
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    parallel_detail::merge_sort(first, last, comp, [](RandomIt begin, RandomIt end, Compare& comp) {
+        std::stable_sort(begin, end, comp);
+    }, partitioner, pool);
+}
 
-    {
-        JoinThreads joiner(threads);
-        Iterator block_start=first;
-        for(int i=0;i<(num_threads-1);++i)
-        {
-            Iterator block_end=block_start;
-            std::advance(block_end,block_size);
-            threads[i]=std::thread(
-                accumulate_block,
-                block_start,block_end,std::ref(results[i]));
-            block_start=block_end;
+// orders by key(element) < key(element)
+template<typename RandomIt, typename Key, typename Partitioner = AutoPartitioner>
+void parallel_sort_by_key(RandomIt first, RandomIt last, Key key,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    parallel_sort(first, last, parallel_detail::KeyCompare<Key>{key}, partitioner, pool);
+}
+
+template<typename RandomIt, typename Key, typename Partitioner = AutoPartitioner>
+void parallel_stable_sort_by_key(RandomIt first, RandomIt last, Key key,
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    parallel_stable_sort(first, last, parallel_detail::KeyCompare<Key>{key}, partitioner, pool);
+}
+
+// the min(k, n) elements that come first in comp order, sorted, e.g.
+// std::greater<>() gives the k largest. every worker keeps a bounded heap
+// of its k best, the heaps are merged at the end: O(n / p + p k log k).
+template<typename Iterator, typename Compare = std::less<>, typename Partitioner = AutoPartitioner>
+std::vector<typename std::iterator_traits<Iterator>::value_type> parallel_top_k(Iterator first, Iterator last,
+    std::size_t k, Compare comp = Compare(), const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    std::size_t length = std::distance(first, last);
+    std::vector<T> result;
+    if(!k || !length) {
+        return result;
+    }
+
+    // heap front is the worst element kept
+    std::vector<CacheAligned<std::vector<T> > > heaps(pool.size() + 1);
+    parallel_detail::for_each_chunk(length, [first, k, &comp, &heaps](int worker, std::size_t begin, std::size_t end) {
+        std::vector<T>& heap = heaps[worker].value;
+        Iterator it = std::next(first, begin);
+        for(; begin < end; ++begin, ++it) {
+            if(heap.size() < k) {
+                heap.push_back(*it);
+                std::push_heap(heap.begin(), heap.end(), comp);
+            } else if(comp(*it, heap.front())) {
+                std::pop_heap(heap.begin(), heap.end(), comp);
+                heap.back() = *it;
+                std::push_heap(heap.begin(), heap.end(), comp);
+            }
         }
-        accumulate_block(block_start,last,results[num_threads-1]);
+    }, partitioner, pool);
+
+    for(auto&& heap : heaps) {
+        std::move(heap.value.begin(), heap.value.end(), std::back_inserter(result));
     }
+    std::size_t count = std::min(k, result.size());
+    std::partial_sort(result.begin(), result.begin() + count, result.end(), comp);
+    result.resize(count);
+    return result;
+}
 
-    return std::accumulate(results.begin(),results.end(),init);
+// rearranges [first, last) so that *nth is the element a full sort would
+// put there, no element before it is greater and none after it is less.
+// every round samples the range, partitions it in parallel around two
+// pivots bracketing the rank of nth and continues in the part holding it,
+// which is a small band around nth with high probability.
+// partitions go through parallel_partition, so the element type must be
+// default constructible.
+template<typename RandomIt, typename Compare = std::less<>, typename Partitioner = AutoPartitioner>
+void parallel_nth_element(RandomIt first, RandomIt nth, RandomIt last, Compare comp = Compare(),
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    constexpr std::size_t SEQUENTIAL_LENGTH = 1 << 14;
+    constexpr std::size_t SAMPLE_SIZE = 1024;
+    constexpr std::size_t BAND = 32;
+    std::minstd_rand engine(234);
+
+    while(nth != last && (std::size_t)(last - first) > SEQUENTIAL_LENGTH) {
+        std::size_t length = last - first;
+        std::vector<T> sample(SAMPLE_SIZE);
+        for(auto&& value : sample) {
+            value = first[engine() % length];
+        }
+        std::sort(sample.begin(), sample.end(), comp);
+        std::size_t rank = (std::size_t)(nth - first) * SAMPLE_SIZE / length;
+        T low = sample[rank > BAND ? rank - BAND : 0];
+        T high = sample[std::min(SAMPLE_SIZE - 1, rank + BAND)];
+
+        RandomIt mid_first = parallel_partition(first, last, [&comp, &low](const T& value) {
+            return comp(value, low);
+        }, partitioner, pool);
+        if(nth < mid_first) {
+            last = mid_first;
+            continue;
+        }
+        RandomIt mid_last = parallel_partition(mid_first, last, [&comp, &high](const T& value) {
+            return !comp(high, value);
+        }, partitioner, pool);
+        if(nth >= mid_last) {
+            first = mid_last;
+            continue;
+        }
+        if(!comp(low, high)) {
+            // the band holds copies of one value only
+            return;
+        }
+        if(mid_first == first && mid_last == last) {
+            // the pivots did not split anything, give up on sampling
+            break;
+        }
+        first = mid_first;
+        last = mid_last;
+    }
+    std::nth_element(first, nth, last, comp);
+}
+
+// [first, middle) gets the smallest elements in order, the rest are left
+// in an unspecified order
+template<typename RandomIt, typename Compare = std::less<>, typename Partitioner = AutoPartitioner>
+void parallel_partial_sort(RandomIt first, RandomIt middle, RandomIt last, Compare comp = Compare(),
+    const Partitioner& partitioner = Partitioner(), ThreadPool& pool = ThreadPool::default_pool()) {
+    if(first == middle) {
+        return;
+    }
+    parallel_nth_element(first, middle - 1, last, comp, partitioner, pool);
+    parallel_sort(first, middle, comp, partitioner, pool);
 }
 
-template<typename Iterator>
-void async_quick_sort(Iterator first, Iterator last) {
-    using T = std::remove_reference<decltype(*first)>::type;
+template<typename Iterator, typename Compare = std::less<> >
+void async_quick_sort(Iterator first, Iterator last, Compare comp = Compare()) {
+    using T = typename std::remove_reference<decltype(*first)>::type;
     int length = std::distance(first, last);
     if(!length)return;
 
     int min_per_thread = 25;
     if(length < min_per_thread) {
-        std::sort(first, last);
+        std::sort(first, last, comp);
         return;
     }
     T mid_value = *next(first, length / 2);
     // split to less and greater_equal
-    Iterator geq_point = std::partition(first, last, [&mid_value](const T& value){
-        return value < mid_value;
+    Iterator geq_point = std::partition(first, last, [&mid_value, &comp](const T& value){
+        return comp(value, mid_value);
     });
     // split to less, equal and greater
-    Iterator greater_point = std::partition(geq_point, last, [&mid_value](const T& value){
-        return value == mid_value;
+    Iterator greater_point = std::partition(geq_point, last, [&mid_value, &comp](const T& value){
+        return !comp(mid_value, value);
     });
 
     std::future<void> lower_result = std::async(
-        &async_quick_sort<Iterator>,
-        first, geq_point
+        &async_quick_sort<Iterator, Compare>,
+        first, geq_point, comp
     );
-    async_quick_sort(greater_point, last);
+    async_quick_sort(greater_point, last, comp);
     lower_result.get();
     return;
 }
 
-template<typename Iterator>
-void thread_pool_quick_sort(Iterator first, Iterator last) {
+template<typename Iterator, typename Compare = std::less<> >
+void thread_pool_quick_sort(Iterator first, Iterator last, Compare comp = Compare()) {
     NoDeadLockThreadPool pool;
     std::function<void(Iterator, Iterator)> do_sort = 
-    [&pool, &do_sort](Iterator first, Iterator last) {
-        using T = std::remove_reference<decltype(*first)>::type;
+    [&pool, &do_sort, &comp](Iterator first, Iterator last) {
+        using T = typename std::remove_reference<decltype(*first)>::type;
         int length = std::distance(first, last);
         if(!length)return;
 
         int min_per_thread = 25;
         if(length < min_per_thread) {
-            std::sort(first, last);
+            std::sort(first, last, comp);
             return;
         }
         T mid_value = *next(first, length / 2);
         // split to less and greater_equal
-        Iterator geq_point = std::partition(first, last, [&mid_value](const T& value){
-            return value < mid_value;
+        Iterator geq_point = std::partition(first, last, [&mid_value, &comp](const T& value){
+            return comp(value, mid_value);
         });
         // split to less, equal and greater
-        Iterator greater_point = std::partition(geq_point, last, [&mid_value](const T& value){
-            return value == mid_value;
+        Iterator greater_point = std::partition(geq_point, last, [&mid_value, &comp](const T& value){
+            return !comp(mid_value, value);
         });
 
         std::future<void> lower_result = pool.submit(
@@ -0,0 +1,365 @@
+#ifndef PARTITIONER_H
+#define PARTITIONER_H
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// a partitioner decides the chunk size the parallel algorithms hand out,
+// grain_size(length, num_workers) is asked once per call, except for
+// AdaptivePartitioner which sizes every chunk.
+
+// fixed chunks of grain elements
+class SimplePartitioner {
+public:
+    explicit SimplePartitioner(std::size_t grain_ = 1):
+    grain(std::max<std::size_t>(1, grain_)) {
+
+    }
+
+    std::size_t grain_size(std::size_t, int) const {
+        return grain;
+    }
+
+private:
+    std::size_t grain;
+};
+
+// a few chunks per worker, enough slack for uneven work to balance
+class AutoPartitioner {
+public:
+    std::size_t grain_size(std::size_t length, int num_workers) const {
+        std::size_t num_chunks = (std::size_t)num_workers * CHUNKS_PER_WORKER;
+        return std::max<std::size_t>(1, length / num_chunks);
+    }
+
+private:
+    static constexpr std::size_t CHUNKS_PER_WORKER = 4;
+};
+
+// for searches that stop at a match: many small chunks, so the work
+// queued behind an early match is short
+class SearchPartitioner {
+public:
+    std::size_t grain_size(std::size_t length, int num_workers) const {
+        std::size_t num_chunks = (std::size_t)num_workers * CHUNKS_PER_WORKER;
+        return std::min(MAX_GRAIN, std::max<std::size_t>(1, length / num_chunks));
+    }
+
+private:
+    static constexpr std::size_t CHUNKS_PER_WORKER = 16;
+    static constexpr std::size_t MAX_GRAIN = 4096;
+};
+
+// measures the cost per element and sizes chunks to take about
+// TARGET_CHUNK_NS each. copies share one estimate, keep one partitioner
+// per call site (e.g. a static local) so each loop keeps its own cost:
+//   static AdaptivePartitioner partitioner;
+//   parallel_for_each(first, last, f, partitioner);
+// parallel_for_range, parallel_for_each and the UNORDERED reductions
+// size every chunk from the running estimate and only start pool tasks
+// once the first chunk showed the loop is worth splitting. the other
+// algorithms need fixed chunks, they take grain_size() from the estimate
+// of earlier calls.
+class AdaptivePartitioner {
+public:
+    AdaptivePartitioner():
+    estimate(std::make_shared<std::atomic<double> >(0.0)) {
+
+    }
+
+    std::size_t grain_size(std::size_t length, int num_workers) const {
+        double cost = ns_per_element();
+        if(cost <= 0) {
+            return AutoPartitioner().grain_size(length, num_workers);
+        }
+        return chunk_size(cost, length, num_workers);
+    }
+
+    // average ns per element seen so far, 0 before the first chunk
+    double ns_per_element() const {
+        return estimate->load(std::memory_order_relaxed);
+    }
+
+    void observe(std::size_t elements, std::uint64_t ns) const {
+        double sample = (double)ns / elements;
+        double old = estimate->load(std::memory_order_relaxed);
+        // racing updates may drop a sample, that is fine for an average
+        estimate->store(old <= 0 ? sample : old + (sample - old) / 4, std::memory_order_relaxed);
+    }
+
+    // whole loops cheaper than this run on the calling thread only
+    static constexpr double MIN_PARALLEL_NS = 20000;
+    static constexpr double TARGET_CHUNK_NS = 20000;
+    // the first chunk of a call without an estimate
+    static constexpr std::size_t PROBE_SIZE = 16;
+
+    static std::size_t chunk_size(double cost, std::size_t length, int num_workers) {
+        // keep a few chunks per worker to balance uneven work
+        std::size_t max_chunk = std::max<std::size_t>(1, length / ((std::size_t)num_workers * 4));
+        double chunk = TARGET_CHUNK_NS / std::max(cost, 0.01);
+        return std::min(max_chunk, std::max<std::size_t>(1, (std::size_t)chunk));
+    }
+
+private:
+    std::shared_ptr<std::atomic<double> > estimate;
+};
+
+// AutoPartitioner chunks, remembering which thread ran every chunk. the
+// next call with the same number of chunks hands every thread the chunks
+// it ran last time before it takes others, so repeated sweeps over the
+// same data find their chunks in that worker's cache. as with
+// AdaptivePartitioner, copies share the record, keep one per loop.
+class AffinityPartitioner {
+public:
+    AffinityPartitioner():
+    state(std::make_shared<State>()) {
+
+    }
+
+    std::size_t grain_size(std::size_t length, int num_workers) const {
+        return AutoPartitioner().grain_size(length, num_workers);
+    }
+
+    // ThreadPool::current_worker() of the thread that ran every chunk of
+    // the last call, empty if that call had another number of chunks
+    std::vector<int> last_owners(std::size_t num_chunks) const {
+        std::lock_guard<std::mutex> lk(state->mut);
+        if(state->owners.size() != num_chunks) {
+            return std::vector<int>();
+        }
+        return state->owners;
+    }
+
+    void record(std::vector<int> owners) const {
+        std::lock_guard<std::mutex> lk(state->mut);
+        state->owners = std::move(owners);
+    }
+
+private:
+    struct State {
+        std::mutex mut;
+        std::vector<int> owners;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+template<typename Partitioner>
+std::size_t resolve_grain_size(const Partitioner& partitioner, std::size_t length, const ThreadPool& pool) {
+    // the calling thread works too
+    return std::max<std::size_t>(1, partitioner.grain_size(length, pool.size() + 1));
+}
+
+namespace parallel_detail {
+
+// runs run(worker) on the calling thread (worker 0) and on num_tasks pool
+// tasks (workers 1..num_tasks). the first exception calls cancel() so the
+// others stop claiming work, and is rethrown once every task is done.
+template<typename Run, typename Cancel>
+void run_workers(std::size_t num_tasks, Run& run, Cancel cancel, ThreadPool& pool) {
+    auto guarded = [&run, &cancel](int worker) {
+        try {
+            run(worker);
+        } catch(...) {
+            cancel();
+            throw;
+        }
+    };
+
+    std::vector<std::future<void> > futures;
+    futures.reserve(num_tasks);
+    std::exception_ptr error;
+    try {
+        for(std::size_t i = 0; i < num_tasks; i++) {
+            int worker = (int)i + 1;
+            futures.push_back(pool.submit([&guarded, worker]() {
+                guarded(worker);
+            }));
+        }
+        guarded(0);
+    } catch(...) {
+        error = std::current_exception();
+        cancel();
+    }
+    // the tasks refer to this frame, wait for all of them
+    for(auto&& future : futures) {
+        pool.wait(future);
+        try {
+            future.get();
+        } catch(...) {
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// body(worker, begin, end), worker is 0 for the calling thread and
+// 1..pool.size() for the tasks, so per worker state can be indexed by it
+template<typename Body>
+void run_chunks(std::size_t length, std::size_t grain, Body body, ThreadPool& pool) {
+    if(!length) {
+        return;
+    }
+    std::size_t num_chunks = (length + grain - 1) / grain;
+    std::atomic<std::size_t> next_chunk(0);
+    auto run = [&](int worker) {
+        std::size_t chunk;
+        while((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < num_chunks) {
+            std::size_t begin = chunk * grain;
+            body(worker, begin, std::min(begin + grain, length));
+        }
+    };
+    run_workers(std::min<std::size_t>(num_chunks - 1, pool.size()), run, [&]() {
+        next_chunk.store(num_chunks, std::memory_order_relaxed);
+    }, pool);
+}
+
+inline std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// like run_chunks, chunk sizes follow the partitioner's running estimate.
+// the calling thread times a first chunk alone and starts pool tasks only
+// if the rest of the loop is worth splitting.
+template<typename Body>
+void run_adaptive(std::size_t length, Body body, const AdaptivePartitioner& partitioner, ThreadPool& pool) {
+    if(!length) {
+        return;
+    }
+    int num_workers = pool.size() + 1;
+    std::atomic<std::size_t> next(0);
+    auto claim_and_run = [&](int worker) {
+        double cost = partitioner.ns_per_element();
+        std::size_t chunk = cost > 0
+            ? AdaptivePartitioner::chunk_size(cost, length, num_workers)
+            : std::min(length, AdaptivePartitioner::PROBE_SIZE);
+        std::size_t begin = next.fetch_add(chunk, std::memory_order_relaxed);
+        if(begin >= length) {
+            return false;
+        }
+        std::size_t end = std::min(begin + chunk, length);
+        auto start = std::chrono::steady_clock::now();
+        body(worker, begin, end);
+        partitioner.observe(end - begin, elapsed_ns(start));
+        return true;
+    };
+
+    claim_and_run(0);
+    std::size_t rest = length - std::min(length, next.load(std::memory_order_relaxed));
+    if(!rest) {
+        return;
+    }
+    if(rest * partitioner.ns_per_element() < AdaptivePartitioner::MIN_PARALLEL_NS) {
+        while(claim_and_run(0));
+        return;
+    }
+
+    auto run = [&](int worker) {
+        while(claim_and_run(worker));
+    };
+    std::size_t chunk = AdaptivePartitioner::chunk_size(partitioner.ns_per_element(), length, num_workers);
+    std::size_t num_chunks = (rest + chunk - 1) / chunk;
+    run_workers(std::min<std::size_t>(num_chunks - 1, pool.size()), run, [&]() {
+        next.store(length, std::memory_order_relaxed);
+    }, pool);
+}
+
+// like run_chunks, every thread first claims the chunks it ran in the
+// partitioner's last call, then joins the shared counter for the rest.
+// body still gets the task's worker number, the thread is only used to
+// pick the chunks.
+template<typename Body>
+void run_affinity(std::size_t length, Body body, const AffinityPartitioner& partitioner, ThreadPool& pool) {
+    if(!length) {
+        return;
+    }
+    std::size_t grain = resolve_grain_size(partitioner, length, pool);
+    std::size_t num_chunks = (length + grain - 1) / grain;
+    std::vector<std::vector<std::size_t> > preferred(pool.size() + 1);
+    std::vector<int> owners = partitioner.last_owners(num_chunks);
+    for(std::size_t chunk = 0; chunk < owners.size(); chunk++) {
+        // a record from a larger pool has threads this one lacks
+        if((std::size_t)owners[chunk] < preferred.size()) {
+            preferred[owners[chunk]].push_back(chunk);
+        }
+    }
+
+    std::unique_ptr<std::atomic<bool>[]> claimed(new std::atomic<bool>[num_chunks]);
+    for(std::size_t chunk = 0; chunk < num_chunks; chunk++) {
+        claimed[chunk].store(false, std::memory_order_relaxed);
+    }
+    // every entry is written by the thread that claimed its chunk
+    std::vector<int> ran(num_chunks, 0);
+    std::atomic<std::size_t> next_chunk(0);
+    std::atomic<bool> cancelled(false);
+    auto run = [&](int worker) {
+        int thread = pool.current_worker();
+        auto try_chunk = [&](std::size_t chunk) {
+            if(claimed[chunk].exchange(true, std::memory_order_relaxed)) {
+                return;
+            }
+            ran[chunk] = thread;
+            std::size_t begin = chunk * grain;
+            body(worker, begin, std::min(begin + grain, length));
+        };
+        for(std::size_t chunk : preferred[thread]) {
+            if(cancelled.load(std::memory_order_relaxed)) {
+                return;
+            }
+            try_chunk(chunk);
+        }
+        std::size_t chunk;
+        while((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < num_chunks) {
+            try_chunk(chunk);
+        }
+    };
+    run_workers(std::min<std::size_t>(num_chunks - 1, pool.size()), run, [&]() {
+        cancelled.store(true, std::memory_order_relaxed);
+        next_chunk.store(num_chunks, std::memory_order_relaxed);
+    }, pool);
+    partitioner.record(std::move(ran));
+}
+
+// run_chunks with the partitioner's grain, or run_adaptive / run_affinity
+template<typename Body, typename Partitioner>
+void for_each_chunk(std::size_t length, Body body, const Partitioner& partitioner, ThreadPool& pool) {
+    if constexpr(std::is_same<Partitioner, AdaptivePartitioner>::value) {
+        run_adaptive(length, body, partitioner, pool);
+    } else if constexpr(std::is_same<Partitioner, AffinityPartitioner>::value) {
+        run_affinity(length, body, partitioner, pool);
+    } else {
+        run_chunks(length, resolve_grain_size(partitioner, length, pool), body, pool);
+    }
+}
+
+}
+
+// calls body(begin, end) for chunks covering [0, length), their size comes
+// from the partitioner. chunks are claimed in order from a shared counter
+// by the calling thread and by at most one task per pool worker, so uneven
+// work balances.
+// the first exception thrown by body cancels the remaining chunks and is
+// rethrown once every task is done.
+template<typename Body, typename Partitioner = AutoPartitioner>
+void parallel_for_range(std::size_t length, Body body, const Partitioner& partitioner = Partitioner(),
+    ThreadPool& pool = ThreadPool::default_pool()) {
+    parallel_detail::for_each_chunk(length, [&body](int, std::size_t begin, std::size_t end) {
+        body(begin, end);
+    }, partitioner, pool);
+}
+
+#endif
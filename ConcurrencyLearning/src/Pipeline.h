@@ -0,0 +1,370 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// a chain of stages fed by a source, run on a ThreadPool:
+//   auto pipeline = make_pipeline([&]() { return read_line(in); })
+//       .then(StageMode::PARALLEL, parse)
+//       .then(StageMode::PARALLEL, transform)
+//       .then(StageMode::SERIAL_IN_ORDER, [&](Record record) { aggregate(record); });
+//   pipeline.run(16, 64);
+// items travel in batches, a batch is one pool task that carries its items
+// through as many stages as it can. a serial stage runs one batch at a time,
+// a batch that finds it busy (or, in order, not its turn) is parked in the
+// stage and picked up by whoever leaves it, so no worker blocks on a stage.
+// the number of batches in flight, parked ones included, is bounded by the
+// tokens given to run(), so a slow stage stops the source instead of
+// queueing up memory.
+
+enum class StageMode {
+    PARALLEL,
+    // one batch at a time, in the order the source produced them
+    SERIAL_IN_ORDER,
+    // one batch at a time, in any order
+    SERIAL_OUT_OF_ORDER
+};
+
+namespace pipeline_detail {
+
+struct ItemsBase {
+    virtual ~ItemsBase() {
+
+    }
+};
+
+template<typename T>
+struct Items: ItemsBase {
+    std::vector<T> items;
+};
+
+struct Batch {
+    std::size_t seq;
+    std::unique_ptr<ItemsBase> items;
+};
+
+struct Stage {
+    explicit Stage(StageMode mode_, std::function<std::unique_ptr<ItemsBase>(std::unique_ptr<ItemsBase>)> run_):
+    mode(mode_), run(std::move(run_)), busy(false), next_seq(0) {
+
+    }
+
+    StageMode mode;
+    std::function<std::unique_ptr<ItemsBase>(std::unique_ptr<ItemsBase>)> run;
+
+    // serial stages only
+    std::mutex mut;
+    bool busy;
+    std::size_t next_seq;
+    // in order stages park by seq, out of order ones in arrival order
+    std::map<std::size_t, Batch> parked_in_order;
+    std::deque<Batch> parked;
+};
+
+class PipelineCore {
+public:
+    // fills a batch of up to batch_size items, nullptr once the source is
+    // exhausted
+    std::function<std::unique_ptr<ItemsBase>(std::size_t)> source;
+    std::vector<std::unique_ptr<Stage> > stages;
+
+    void run(std::size_t max_tokens_, std::size_t batch_size_, ThreadPool& pool_) {
+        pool = &pool_;
+        max_tokens = max_tokens_ ? max_tokens_ : 4 * (std::size_t)(pool_.size() + 1);
+        batch_size = std::max<std::size_t>(1, batch_size_);
+        tokens = 0;
+        next_seq = 0;
+        source_done = false;
+        cancelled.store(false);
+        error = nullptr;
+        for(auto&& stage : stages) {
+            stage->busy = false;
+            stage->next_seq = 0;
+        }
+        done = std::make_shared<std::promise<void> >();
+        std::future<void> finished = done->get_future();
+
+        release_and_read(0);
+        pool->wait(finished);
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    // gives back released tokens and reads new batches while tokens are
+    // left. nothing may touch this once the last token is back, run()
+    // returns as soon as done is set.
+    void release_and_read(std::size_t released) {
+        bool failed = false;
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lk(source_mut);
+            tokens -= released;
+            while(!source_done && !cancelled.load() && tokens < max_tokens) {
+                std::unique_ptr<ItemsBase> items;
+                try {
+                    items = source(batch_size);
+                } catch(...) {
+                    cancel(std::current_exception());
+                    failed = true;
+                    // held until the stages are drained
+                    tokens++;
+                    break;
+                }
+                if(!items) {
+                    source_done = true;
+                    break;
+                }
+                tokens++;
+                submit(Batch{next_seq++, std::move(items)}, 0);
+            }
+            finished = tokens == 0 && (source_done || cancelled.load());
+        }
+        if(finished) {
+            // keeps the promise alive if run() returns meanwhile
+            std::shared_ptr<std::promise<void> > promise = done;
+            promise->set_value();
+        } else if(failed) {
+            drain_stages(1);
+        }
+    }
+
+    void submit(Batch batch, std::size_t stage) {
+        // the future is not needed, the last token signals the end
+        pool->submit([this, batch = std::move(batch), stage]() mutable {
+            process(std::move(batch), stage);
+        });
+    }
+
+    void cancel(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lk(error_mut);
+        if(!error) {
+            error = e;
+        }
+        cancelled.store(true);
+    }
+
+    // drops the parked batches of every stage and gives their tokens back
+    // together with released ones
+    void drain_stages(std::size_t released) {
+        for(auto&& stage : stages) {
+            std::lock_guard<std::mutex> lk(stage->mut);
+            released += drop_parked(*stage);
+        }
+        release_and_read(released);
+    }
+
+    static std::size_t drop_parked(Stage& stage) {
+        std::size_t dropped = stage.parked_in_order.size() + stage.parked.size();
+        stage.parked_in_order.clear();
+        stage.parked.clear();
+        return dropped;
+    }
+
+    bool run_stage(Stage& stage, Batch& batch) {
+        try {
+            batch.items = stage.run(std::move(batch.items));
+            return true;
+        } catch(...) {
+            cancel(std::current_exception());
+            return false;
+        }
+    }
+
+    void process(Batch batch, std::size_t index) {
+        for(; index < stages.size(); index++) {
+            Stage& stage = *stages[index];
+            if(stage.mode == StageMode::PARALLEL) {
+                if(cancelled.load() || !run_stage(stage, batch)) {
+                    break;
+                }
+                continue;
+            }
+
+            bool in_order = stage.mode == StageMode::SERIAL_IN_ORDER;
+            bool entered = false;
+            std::size_t dropped = 0;
+            {
+                std::lock_guard<std::mutex> lk(stage.mut);
+                if(cancelled.load()) {
+                    dropped = drop_parked(stage);
+                } else if(stage.busy || (in_order && batch.seq != stage.next_seq)) {
+                    std::size_t seq = batch.seq;
+                    if(in_order) {
+                        stage.parked_in_order.emplace(seq, std::move(batch));
+                    } else {
+                        stage.parked.push_back(std::move(batch));
+                    }
+                    // the token travels with the parked batch
+                    return;
+                } else {
+                    stage.busy = true;
+                    entered = true;
+                }
+            }
+            if(!entered) {
+                release_and_read(dropped + 1);
+                return;
+            }
+
+            bool ok = run_stage(stage, batch);
+
+            // hand the stage to the next parked batch that may enter it
+            std::optional<Batch> next;
+            {
+                std::lock_guard<std::mutex> lk(stage.mut);
+                stage.busy = false;
+                stage.next_seq++;
+                if(cancelled.load()) {
+                    dropped = drop_parked(stage);
+                } else if(in_order) {
+                    auto it = stage.parked_in_order.find(stage.next_seq);
+                    if(it != stage.parked_in_order.end()) {
+                        next = std::move(it->second);
+                        stage.parked_in_order.erase(it);
+                    }
+                } else if(!stage.parked.empty()) {
+                    next = std::move(stage.parked.front());
+                    stage.parked.pop_front();
+                }
+            }
+            if(next) {
+                submit(std::move(*next), index);
+            }
+            if(!ok) {
+                drain_stages(dropped + 1);
+                return;
+            }
+            if(dropped) {
+                release_and_read(dropped);
+            }
+        }
+        if(cancelled.load()) {
+            drain_stages(1);
+        } else {
+            release_and_read(1);
+        }
+    }
+
+    ThreadPool* pool;
+    std::size_t max_tokens;
+    std::size_t batch_size;
+
+    std::mutex source_mut;
+    std::size_t tokens;
+    std::size_t next_seq;
+    bool source_done;
+
+    std::atomic<bool> cancelled;
+    std::mutex error_mut;
+    std::exception_ptr error;
+    std::shared_ptr<std::promise<void> > done;
+};
+
+}
+
+template<typename T>
+class Pipeline;
+
+template<typename Source>
+auto make_pipeline(Source source);
+
+// items of type T leave the last stage added so far, void after a sink
+template<typename T>
+class Pipeline {
+public:
+    // a stage calls f(item) for every item and passes the results on, a
+    // stage whose f returns void ends the chain. PARALLEL stages call the
+    // same f from several threads at once, serial ones one at a time.
+    template<typename Func, typename In = T>
+    Pipeline<std::invoke_result_t<Func&, In&&> > then(StageMode mode, Func f) && {
+        using Out = std::invoke_result_t<Func&, In&&>;
+        core->stages.push_back(std::make_unique<pipeline_detail::Stage>(mode,
+            [f](std::unique_ptr<pipeline_detail::ItemsBase> batch) mutable -> std::unique_ptr<pipeline_detail::ItemsBase> {
+                std::vector<T>& in = static_cast<pipeline_detail::Items<T>&>(*batch).items;
+                if constexpr(std::is_void<Out>::value) {
+                    for(auto&& item : in) {
+                        f(std::move(item));
+                    }
+                    return nullptr;
+                } else {
+                    auto out = std::make_unique<pipeline_detail::Items<Out> >();
+                    out->items.reserve(in.size());
+                    for(auto&& item : in) {
+                        out->items.push_back(f(std::move(item)));
+                    }
+                    return out;
+                }
+            }));
+        return Pipeline<Out>(std::move(core));
+    }
+
+    // runs until the source is exhausted, on the pool's workers and on the
+    // calling thread. at most max_tokens batches of up to batch_size items
+    // are in flight, 0 tokens means 4 per worker. the first exception of a
+    // stage or of the source stops reading and is rethrown once the batches
+    // in flight are done.
+    void run(std::size_t max_tokens = 0, std::size_t batch_size = 1,
+        ThreadPool& pool = ThreadPool::default_pool()) {
+        core->run(max_tokens, batch_size, pool);
+    }
+
+private:
+    template<typename U>
+    friend class Pipeline;
+
+    template<typename Source>
+    friend auto make_pipeline(Source source);
+
+    explicit Pipeline(std::unique_ptr<pipeline_detail::PipelineCore> core_):
+    core(std::move(core_)) {
+
+    }
+
+    std::unique_ptr<pipeline_detail::PipelineCore> core;
+};
+
+// source() returns std::optional<T>, nullopt once it is exhausted. it is
+// called by one thread at a time, the items keep its order within the
+// SERIAL_IN_ORDER stages.
+template<typename Source>
+auto make_pipeline(Source source) {
+    using T = typename std::invoke_result_t<Source&>::value_type;
+    auto core = std::make_unique<pipeline_detail::PipelineCore>();
+    core->source = [source, exhausted = false](std::size_t batch_size) mutable -> std::unique_ptr<pipeline_detail::ItemsBase> {
+        if(exhausted) {
+            return nullptr;
+        }
+        auto batch = std::make_unique<pipeline_detail::Items<T> >();
+        batch->items.reserve(batch_size);
+        while(batch->items.size() < batch_size) {
+            std::optional<T> item = source();
+            if(!item) {
+                exhausted = true;
+                break;
+            }
+            batch->items.push_back(std::move(*item));
+        }
+        if(batch->items.empty()) {
+            return nullptr;
+        }
+        return batch;
+    };
+    return Pipeline<T>(std::move(core));
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef RWSPINLOCK_H
+#define RWSPINLOCK_H
+
+#include "SpinLockMutex.h"
+#include "CacheLine.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace rw_spin_detail {
+
+constexpr int MAX_SPINS = 128;
+
+// pause while cond holds, yield every MAX_SPINS rounds so a preempted
+// holder gets the core back
+template<typename Cond>
+void spin_while(Cond cond) {
+	int spins = 0;
+	while (cond()) {
+		cpu_relax();
+		if (++spins >= MAX_SPINS) {
+			std::this_thread::yield();
+			spins = 0;
+		}
+	}
+}
+
+}
+
+// one word reader-writer spinlock
+// bit 0 is the writer flag, bit 1 marks a waiting writer, the remaining
+// bits count readers. new readers stay out while a writer waits, so a
+// steady stream of readers cannot starve writers.
+class RWSpinLock {
+public:
+	RWSpinLock():
+	state(0) {
+
+	}
+
+	void lock() {
+		std::uint32_t expect = 0;
+		while (!state.compare_exchange_weak(expect, WRITER,
+			std::memory_order_acquire, std::memory_order_relaxed)) {
+			// taking the lock clears the mark, so every waiter renews it
+			if (!(expect & WRITER_WAITING)) {
+				state.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+			}
+			// spin on a plain load so waiters share the cache line
+			rw_spin_detail::spin_while([this]() {
+				return (state.load(std::memory_order_relaxed) & ~WRITER_WAITING) != 0;
+			});
+			expect = WRITER_WAITING;
+		}
+	}
+
+	bool try_lock() {
+		std::uint32_t expect = state.load(std::memory_order_relaxed) & WRITER_WAITING;
+		return state.compare_exchange_strong(expect, WRITER,
+			std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock() {
+		// readers may be backing out meanwhile, keep their count
+		state.fetch_sub(WRITER, std::memory_order_release);
+	}
+
+	void lock_shared() {
+		while (true) {
+			rw_spin_detail::spin_while([this]() {
+				return (state.load(std::memory_order_relaxed) & (WRITER | WRITER_WAITING)) != 0;
+			});
+			if (try_lock_shared()) {
+				return;
+			}
+		}
+	}
+
+	bool try_lock_shared() {
+		std::uint32_t value = state.fetch_add(READER, std::memory_order_acquire);
+		if (value & (WRITER | WRITER_WAITING)) {
+			state.fetch_sub(READER, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	void unlock_shared() {
+		state.fetch_sub(READER, std::memory_order_release);
+	}
+
+private:
+	static constexpr std::uint32_t WRITER = 1;
+	static constexpr std::uint32_t WRITER_WAITING = 2;
+	static constexpr std::uint32_t READER = 4;
+
+	std::atomic<std::uint32_t> state;
+};
+
+// reader-writer spinlock with the reader count split over NumSlots cache
+// aligned counters. a reader only touches the counter of its own slot, so
+// readers on different cores do not bounce one cache line between them.
+// the writer raises a flag and then waits for every slot to drain, which
+// makes writes O(NumSlots): meant for read mostly data.
+// threads are spread over the slots round robin on first use.
+template<int NumSlots = 16>
+class DistributedRWSpinLock {
+public:
+	static_assert(NumSlots > 0 && (NumSlots & (NumSlots - 1)) == 0, "NumSlots must be a power of two");
+
+	DistributedRWSpinLock():
+	writer(false) {
+		for (int i = 0; i < NumSlots; i++) {
+			readers[i].value.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void lock() {
+		bool expect = false;
+		while (!writer.compare_exchange_weak(expect, true, std::memory_order_seq_cst)) {
+			expect = false;
+			rw_spin_detail::spin_while([this]() {
+				return writer.load(std::memory_order_relaxed);
+			});
+		}
+		// pairs with the fetch_add + load in lock_shared
+		for (int i = 0; i < NumSlots; i++) {
+			rw_spin_detail::spin_while([this, i]() {
+				return readers[i].value.load(std::memory_order_seq_cst) != 0;
+			});
+		}
+	}
+
+	bool try_lock() {
+		bool expect = false;
+		if (!writer.compare_exchange_strong(expect, true, std::memory_order_seq_cst)) {
+			return false;
+		}
+		for (int i = 0; i < NumSlots; i++) {
+			if (readers[i].value.load(std::memory_order_seq_cst) != 0) {
+				writer.store(false, std::memory_order_release);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void unlock() {
+		writer.store(false, std::memory_order_release);
+	}
+
+	void lock_shared() {
+		std::atomic<std::uint32_t>& counter = readers[slot()].value;
+		while (true) {
+			counter.fetch_add(1, std::memory_order_seq_cst);
+			if (!writer.load(std::memory_order_seq_cst)) {
+				return;
+			}
+			// let the writer drain us
+			counter.fetch_sub(1, std::memory_order_relaxed);
+			rw_spin_detail::spin_while([this]() {
+				return writer.load(std::memory_order_relaxed);
+			});
+		}
+	}
+
+	bool try_lock_shared() {
+		std::atomic<std::uint32_t>& counter = readers[slot()].value;
+		counter.fetch_add(1, std::memory_order_seq_cst);
+		if (!writer.load(std::memory_order_seq_cst)) {
+			return true;
+		}
+		counter.fetch_sub(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	void unlock_shared() {
+		readers[slot()].value.fetch_sub(1, std::memory_order_release);
+	}
+
+private:
+	static int slot() {
+		static std::atomic<int> next_slot(0);
+		thread_local int my_slot = next_slot.fetch_add(1, std::memory_order_relaxed) & (NumSlots - 1);
+		return my_slot;
+	}
+
+	CacheAligned< std::atomic<std::uint32_t> > readers[NumSlots];
+	alignas(CACHE_LINE_SIZE) std::atomic<bool> writer;
+};
+
+#endif // !RWSPINLOCK_H
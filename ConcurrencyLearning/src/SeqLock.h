@@ -0,0 +1,106 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include "SpinLockMutex.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// sequence lock for small trivially copyable values such as config
+// snapshots or counters: readers never write shared memory, they copy the
+// value and retry if a writer was active meanwhile. writers are serialized
+// by making the sequence odd while they update.
+// the value is kept in relaxed atomic words, so a torn copy is discarded
+// rather than being a data race.
+template<typename T>
+class SeqLock {
+public:
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable value");
+
+	SeqLock(const T& value = T()):
+	seq(0) {
+		write_words(value);
+	}
+
+	T load() const {
+		T value;
+		int spins = 0;
+		while (true) {
+			std::uint64_t before = seq.load(std::memory_order_acquire);
+			if (before & 1) {
+				backoff(spins);
+				continue;
+			}
+			read_words(value);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq.load(std::memory_order_relaxed) == before) {
+				return value;
+			}
+		}
+	}
+
+	void store(const T& value) {
+		std::uint64_t before = begin_write();
+		write_words(value);
+		seq.store(before + 2, std::memory_order_release);
+	}
+
+	// read-modify-write under the writer lock, f(T&) edits a copy
+	template<typename Func>
+	void update(Func f) {
+		std::uint64_t before = begin_write();
+		T value;
+		read_words(value);
+		f(value);
+		write_words(value);
+		seq.store(before + 2, std::memory_order_release);
+	}
+
+private:
+	static constexpr int MAX_SPINS = 128;
+	static constexpr std::size_t NUM_WORDS = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+	std::uint64_t begin_write() {
+		std::uint64_t before = seq.load(std::memory_order_relaxed);
+		int spins = 0;
+		while ((before & 1) || !seq.compare_exchange_weak(before, before + 1, std::memory_order_relaxed)) {
+			backoff(spins);
+			before = seq.load(std::memory_order_relaxed);
+		}
+		// keep the data stores after the odd sequence
+		std::atomic_thread_fence(std::memory_order_release);
+		return before;
+	}
+
+	// the writer may be descheduled inside its section
+	static void backoff(int& spins) {
+		cpu_relax();
+		if (++spins >= MAX_SPINS) {
+			std::this_thread::yield();
+			spins = 0;
+		}
+	}
+
+	void read_words(T& value) const {
+		std::uint64_t buffer[NUM_WORDS];
+		for (std::size_t i = 0; i < NUM_WORDS; i++) {
+			buffer[i] = words[i].load(std::memory_order_relaxed);
+		}
+		std::memcpy(&value, buffer, sizeof(T));
+	}
+
+	void write_words(const T& value) {
+		std::uint64_t buffer[NUM_WORDS] = {};
+		std::memcpy(buffer, &value, sizeof(T));
+		for (std::size_t i = 0; i < NUM_WORDS; i++) {
+			words[i].store(buffer[i], std::memory_order_relaxed);
+		}
+	}
+
+	std::atomic<std::uint64_t> seq;
+	std::atomic<std::uint64_t> words[NUM_WORDS];
+};
+
+#endif
@@ -0,0 +1,421 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+// vectorized sum and find over contiguous int / float / double arrays,
+// the instruction set is picked once at runtime.
+// gcc and clang on x86 build SSE2, AVX2 and AVX-512 kernels through
+// target attributes, msvc on x64 uses SSE2, other targets stay scalar.
+// int sums wrap like unsigned arithmetic. float sums add in vector lanes,
+// so they round differently from a sequential sum but are the same on
+// every run on a given machine.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SIMD_KERNELS_X86 1
+#define SIMD_KERNELS_TARGETS 1
+#include <immintrin.h>
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMD_KERNELS_X86 1
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+enum class SimdLevel {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+inline SimdLevel detect_simd_level() {
+#if defined(SIMD_KERNELS_TARGETS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    return SimdLevel::SSE2;
+#elif defined(SIMD_KERNELS_X86)
+    return SimdLevel::SSE2;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+inline SimdLevel simd_level() {
+    static const SimdLevel level = detect_simd_level();
+    return level;
+}
+
+// the element types with kernels
+template<typename T>
+struct IsSimdElement: std::integral_constant<bool,
+    std::is_same<T, std::int32_t>::value || std::is_same<T, float>::value || std::is_same<T, double>::value> {
+
+};
+
+namespace simd_detail {
+
+template<typename Iterator, typename = void>
+struct IsVectorIterator: std::false_type {
+
+};
+
+template<typename Iterator>
+struct IsVectorIterator<Iterator, std::enable_if_t<
+    !std::is_same<typename std::iterator_traits<Iterator>::value_type, bool>::value &&
+    (std::is_same<Iterator, typename std::vector<typename std::iterator_traits<Iterator>::value_type>::iterator>::value ||
+    std::is_same<Iterator, typename std::vector<typename std::iterator_traits<Iterator>::value_type>::const_iterator>::value)> >:
+    std::true_type {
+
+};
+
+inline std::int32_t wrap_add(std::int32_t lhs, std::int32_t rhs) {
+    return (std::int32_t)((std::uint32_t)lhs + (std::uint32_t)rhs);
+}
+
+inline float add(float lhs, float rhs) {
+    return lhs + rhs;
+}
+
+inline double add(double lhs, double rhs) {
+    return lhs + rhs;
+}
+
+inline std::int32_t add(std::int32_t lhs, std::int32_t rhs) {
+    return wrap_add(lhs, rhs);
+}
+
+inline int lowest_bit(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+template<typename T>
+T scalar_sum(const T* data, std::size_t n) {
+    T sum = T();
+    for(std::size_t i = 0; i < n; i++) {
+        sum = add(sum, data[i]);
+    }
+    return sum;
+}
+
+template<typename T>
+std::size_t scalar_find(const T* data, std::size_t n, T value) {
+    for(std::size_t i = 0; i < n; i++) {
+        if(data[i] == value) {
+            return i;
+        }
+    }
+    return n;
+}
+
+#if defined(SIMD_KERNELS_X86)
+
+// SSE2, 4 accumulators hide the add latency
+inline std::int32_t sse2_sum(const std::int32_t* data, std::size_t n) {
+    __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm_add_epi32(acc[k], _mm_loadu_si128((const __m128i*)(data + i + 4 * k)));
+        }
+    }
+    __m128i total = _mm_add_epi32(_mm_add_epi32(acc[0], acc[1]), _mm_add_epi32(acc[2], acc[3]));
+    alignas(16) std::int32_t lanes[4];
+    _mm_store_si128((__m128i*)lanes, total);
+    std::int32_t sum = scalar_sum(lanes, 4);
+    return wrap_add(sum, scalar_sum(data + i, n - i));
+}
+
+inline float sse2_sum(const float* data, std::size_t n) {
+    __m128 acc[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm_add_ps(acc[k], _mm_loadu_ps(data + i + 4 * k));
+        }
+    }
+    __m128 total = _mm_add_ps(_mm_add_ps(acc[0], acc[1]), _mm_add_ps(acc[2], acc[3]));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, total);
+    return scalar_sum(lanes, 4) + scalar_sum(data + i, n - i);
+}
+
+inline double sse2_sum(const double* data, std::size_t n) {
+    __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm_add_pd(acc[k], _mm_loadu_pd(data + i + 2 * k));
+        }
+    }
+    __m128d total = _mm_add_pd(_mm_add_pd(acc[0], acc[1]), _mm_add_pd(acc[2], acc[3]));
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, total);
+    return scalar_sum(lanes, 2) + scalar_sum(data + i, n - i);
+}
+
+inline std::size_t sse2_find(const std::int32_t* data, std::size_t n, std::int32_t value) {
+    __m128i key = _mm_set1_epi32(value);
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i)), key);
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(eq));
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+inline std::size_t sse2_find(const float* data, std::size_t n, float value) {
+    __m128 key = _mm_set1_ps(value);
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(data + i), key));
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+inline std::size_t sse2_find(const double* data, std::size_t n, double value) {
+    __m128d key = _mm_set1_pd(value);
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2) {
+        unsigned mask = (unsigned)_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), key));
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+#endif
+
+#if defined(SIMD_KERNELS_TARGETS)
+
+SIMD_TARGET("avx2") inline std::int32_t avx2_sum(const std::int32_t* data, std::size_t n) {
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    std::size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm256_add_epi32(acc[k], _mm256_loadu_si256((const __m256i*)(data + i + 8 * k)));
+        }
+    }
+    __m256i total = _mm256_add_epi32(_mm256_add_epi32(acc[0], acc[1]), _mm256_add_epi32(acc[2], acc[3]));
+    alignas(32) std::int32_t lanes[8];
+    _mm256_store_si256((__m256i*)lanes, total);
+    return wrap_add(scalar_sum(lanes, 8), scalar_sum(data + i, n - i));
+}
+
+SIMD_TARGET("avx2") inline float avx2_sum(const float* data, std::size_t n) {
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    std::size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm256_add_ps(acc[k], _mm256_loadu_ps(data + i + 8 * k));
+        }
+    }
+    __m256 total = _mm256_add_ps(_mm256_add_ps(acc[0], acc[1]), _mm256_add_ps(acc[2], acc[3]));
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, total);
+    return scalar_sum(lanes, 8) + scalar_sum(data + i, n - i);
+}
+
+SIMD_TARGET("avx2") inline double avx2_sum(const double* data, std::size_t n) {
+    __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm256_add_pd(acc[k], _mm256_loadu_pd(data + i + 4 * k));
+        }
+    }
+    __m256d total = _mm256_add_pd(_mm256_add_pd(acc[0], acc[1]), _mm256_add_pd(acc[2], acc[3]));
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, total);
+    return scalar_sum(lanes, 4) + scalar_sum(data + i, n - i);
+}
+
+SIMD_TARGET("avx2") inline std::size_t avx2_find(const std::int32_t* data, std::size_t n, std::int32_t value) {
+    __m256i key = _mm256_set1_epi32(value);
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), key);
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+SIMD_TARGET("avx2") inline std::size_t avx2_find(const float* data, std::size_t n, float value) {
+    __m256 key = _mm256_set1_ps(value);
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), key, _CMP_EQ_OQ));
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+SIMD_TARGET("avx2") inline std::size_t avx2_find(const double* data, std::size_t n, double value) {
+    __m256d key = _mm256_set1_pd(value);
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        unsigned mask = (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), key, _CMP_EQ_OQ));
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+SIMD_TARGET("avx512f") inline std::int32_t avx512_sum(const std::int32_t* data, std::size_t n) {
+    __m512i acc[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512()};
+    std::size_t i = 0;
+    for(; i + 64 <= n; i += 64) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm512_add_epi32(acc[k], _mm512_loadu_si512((const void*)(data + i + 16 * k)));
+        }
+    }
+    __m512i total = _mm512_add_epi32(_mm512_add_epi32(acc[0], acc[1]), _mm512_add_epi32(acc[2], acc[3]));
+    alignas(64) std::int32_t lanes[16];
+    _mm512_store_si512((void*)lanes, total);
+    return wrap_add(scalar_sum(lanes, 16), scalar_sum(data + i, n - i));
+}
+
+SIMD_TARGET("avx512f") inline float avx512_sum(const float* data, std::size_t n) {
+    __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+    std::size_t i = 0;
+    for(; i + 64 <= n; i += 64) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm512_add_ps(acc[k], _mm512_loadu_ps(data + i + 16 * k));
+        }
+    }
+    __m512 total = _mm512_add_ps(_mm512_add_ps(acc[0], acc[1]), _mm512_add_ps(acc[2], acc[3]));
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, total);
+    return scalar_sum(lanes, 16) + scalar_sum(data + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline double avx512_sum(const double* data, std::size_t n) {
+    __m512d acc[4] = {_mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd()};
+    std::size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        for(int k = 0; k < 4; k++) {
+            acc[k] = _mm512_add_pd(acc[k], _mm512_loadu_pd(data + i + 8 * k));
+        }
+    }
+    __m512d total = _mm512_add_pd(_mm512_add_pd(acc[0], acc[1]), _mm512_add_pd(acc[2], acc[3]));
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, total);
+    return scalar_sum(lanes, 8) + scalar_sum(data + i, n - i);
+}
+
+SIMD_TARGET("avx512f") inline std::size_t avx512_find(const std::int32_t* data, std::size_t n, std::int32_t value) {
+    __m512i key = _mm512_set1_epi32(value);
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        unsigned mask = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512((const void*)(data + i)), key);
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+SIMD_TARGET("avx512f") inline std::size_t avx512_find(const float* data, std::size_t n, float value) {
+    __m512 key = _mm512_set1_ps(value);
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        unsigned mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(data + i), key, _CMP_EQ_OQ);
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+SIMD_TARGET("avx512f") inline std::size_t avx512_find(const double* data, std::size_t n, double value) {
+    __m512d key = _mm512_set1_pd(value);
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        unsigned mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(data + i), key, _CMP_EQ_OQ);
+        if(mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+    return i + scalar_find(data + i, n - i, value);
+}
+
+#endif
+
+}
+
+// pointers and vector iterators, the ranges &*first can stand for
+template<typename Iterator>
+struct IsContiguousIterator: std::integral_constant<bool,
+    std::is_pointer<Iterator>::value || simd_detail::IsVectorIterator<Iterator>::value> {
+
+};
+
+// a level above what the machine supports falls back to the best one below
+template<typename T>
+T simd_sum(const T* data, std::size_t n, SimdLevel level = simd_level()) {
+    static_assert(IsSimdElement<T>::value, "no kernel for this element type");
+#if defined(SIMD_KERNELS_TARGETS)
+    if(level == SimdLevel::AVX512 && simd_level() == SimdLevel::AVX512) {
+        return simd_detail::avx512_sum(data, n);
+    }
+    if(level >= SimdLevel::AVX2 && simd_level() >= SimdLevel::AVX2) {
+        return simd_detail::avx2_sum(data, n);
+    }
+#endif
+#if defined(SIMD_KERNELS_X86)
+    if(level >= SimdLevel::SSE2) {
+        return simd_detail::sse2_sum(data, n);
+    }
+#endif
+    return simd_detail::scalar_sum(data, n);
+}
+
+// index of the first element equal to value, n if there is none
+template<typename T>
+std::size_t simd_find(const T* data, std::size_t n, T value, SimdLevel level = simd_level()) {
+    static_assert(IsSimdElement<T>::value, "no kernel for this element type");
+#if defined(SIMD_KERNELS_TARGETS)
+    if(level == SimdLevel::AVX512 && simd_level() == SimdLevel::AVX512) {
+        return simd_detail::avx512_find(data, n, value);
+    }
+    if(level >= SimdLevel::AVX2 && simd_level() >= SimdLevel::AVX2) {
+        return simd_detail::avx2_find(data, n, value);
+    }
+#endif
+#if defined(SIMD_KERNELS_X86)
+    if(level >= SimdLevel::SSE2) {
+        return simd_detail::sse2_find(data, n, value);
+    }
+#endif
+    return simd_detail::scalar_find(data, n, value);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include "SpinLockMutex.h"
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <new>
+
+// fixed size object pool: memory comes in chunks of ChunkSize slots,
+// freed slots go to an intrusive free list and are handed out again.
+// returns raw storage, callers construct and destroy the objects.
+// nodes of one container end up next to each other instead of being
+// scattered over the heap, and there is no per object malloc header.
+template<typename T, std::size_t ChunkSize = 1024>
+class SlabPool {
+private:
+    union Slot {
+        Slot* next_free;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+public:
+    SlabPool():
+    free_list(nullptr) {
+
+    }
+
+    ~SlabPool() {
+        for(Slot* chunk : chunks) {
+            ::operator delete(chunk, std::align_val_t(alignof(Slot)));
+        }
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    void* allocate() {
+        std::lock_guard<ByteSpinLock> lk(mut);
+        if(!free_list) {
+            grow();
+        }
+        Slot* slot = free_list;
+        free_list = slot->next_free;
+        return slot->storage;
+    }
+
+    void deallocate(void* ptr) {
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        std::lock_guard<ByteSpinLock> lk(mut);
+        slot->next_free = free_list;
+        free_list = slot;
+    }
+
+    std::size_t capacity() const {
+        std::lock_guard<ByteSpinLock> lk(mut);
+        return chunks.size() * ChunkSize;
+    }
+
+private:
+    void grow() {
+        Slot* chunk = static_cast<Slot*>(
+            ::operator new(sizeof(Slot) * ChunkSize, std::align_val_t(alignof(Slot))));
+        chunks.push_back(chunk);
+        // link back to front so slots are handed out in address order
+        for(std::size_t i = ChunkSize; i > 0; i--) {
+            chunk[i - 1].next_free = free_list;
+            free_list = &chunk[i - 1];
+        }
+    }
+
+    Slot* free_list;
+    std::vector<Slot*> chunks;
+    mutable ByteSpinLock mut;
+};
+
+#endif
@@ -2,6 +2,22 @@
 #define SPINLOCKMUTEX_H
 
 #include<atomic>
+#include<thread>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include<intrin.h>
+#endif
+
+// tell the cpu we are in a spin-wait loop: on x86 pause saves power and
+// avoids the memory order mis-speculation penalty when the lock is released
+inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
 
 class SpinLockMutex {
 public:
@@ -14,6 +30,10 @@ public:
 		while (flag.test_and_set(std::memory_order_acquire));
 	}
 
+	bool try_lock() {
+		return !flag.test_and_set(std::memory_order_acquire);
+	}
+
 	void unlock() {
 		flag.clear(std::memory_order_release);
 	}
@@ -22,4 +42,91 @@ private:
 	std::atomic_flag flag;
 };
 
+// test-and-test-and-set lock with bounded exponential backoff.
+// waiters spin on a relaxed load, so the cache line stays shared until the
+// holder releases it, and only then race with a single exchange.
+// after a failed race a waiter backs off for a growing number of pauses,
+// once the backoff is at its cap it also yields in case the holder
+// got descheduled.
+class TTASSpinLock {
+public:
+	TTASSpinLock():
+	locked(false) {
+
+	}
+
+	void lock() {
+		int backoff = MIN_BACKOFF;
+		while (true) {
+			if (!locked.exchange(true, std::memory_order_acquire)) {
+				return;
+			}
+			while (locked.load(std::memory_order_relaxed)) {
+				for (int i = 0; i < backoff; i++) {
+					cpu_relax();
+				}
+				if (backoff < MAX_BACKOFF) {
+					backoff <<= 1;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+
+	bool try_lock() {
+		return !locked.load(std::memory_order_relaxed) &&
+			!locked.exchange(true, std::memory_order_acquire);
+	}
+
+	void unlock() {
+		locked.store(false, std::memory_order_release);
+	}
+
+private:
+	static constexpr int MIN_BACKOFF = 4;
+	static constexpr int MAX_BACKOFF = 1024;
+
+	std::atomic<bool> locked;
+};
+
+// single byte lock for memory lean structures (e.g. per node locks),
+// spins on a plain load and yields once the holder seems descheduled
+class ByteSpinLock {
+public:
+	ByteSpinLock():
+	locked(false) {
+
+	}
+
+	void lock() {
+		while (locked.exchange(true, std::memory_order_acquire)) {
+			int spins = 0;
+			while (locked.load(std::memory_order_relaxed)) {
+				cpu_relax();
+				if (++spins >= MAX_SPINS) {
+					std::this_thread::yield();
+					spins = 0;
+				}
+			}
+		}
+	}
+
+	bool try_lock() {
+		return !locked.load(std::memory_order_relaxed) &&
+			!locked.exchange(true, std::memory_order_acquire);
+	}
+
+	void unlock() {
+		locked.store(false, std::memory_order_release);
+	}
+
+private:
+	static constexpr int MAX_SPINS = 64;
+
+	std::atomic<bool> locked;
+};
+
+static_assert(sizeof(ByteSpinLock) == 1, "ByteSpinLock must stay one byte");
+
 #endif // !SPINLOCKMUTEX_H
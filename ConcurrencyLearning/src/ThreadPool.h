@@ -6,6 +6,10 @@
 #include <thread>
 #include <future>
 #include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+#include <vector>
 
 struct FunctionWrapper {
 private:
@@ -40,8 +44,11 @@ public:
     }
 
     FunctionWrapper& operator=(FunctionWrapper&& wrapper) {
-        impl = wrapper.impl;
-        wrapper.impl = nullptr;
+        if(this != &wrapper) {
+            delete impl;
+            impl = wrapper.impl;
+            wrapper.impl = nullptr;
+        }
         return *this;
     }
 
@@ -53,6 +60,10 @@ public:
         impl->call();
     }
 
+    explicit operator bool() const {
+        return impl != nullptr;
+    }
+
     ~FunctionWrapper() {
         delete impl;
     }
@@ -64,10 +75,13 @@ private:
 // this bad thread pool has the problem of dead lock
 class DeadLockThreadPool {
 public:
-    DeadLockThreadPool():done(false), joiner(threads) {
-        int num_hardware_threads = std::thread::hardware_concurrency();
+    // num_threads <= 0 means one worker per hardware thread
+    explicit DeadLockThreadPool(int num_threads = 0):done(false), joiner(threads) {
+        if(num_threads <= 0) {
+            num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
         try {
-            for(int i = 0; i < num_hardware_threads; i++) {
+            for(int i = 0; i < num_threads; i++) {
                 threads.emplace_back(std::thread(
                     &DeadLockThreadPool::do_work_per_thread,
                     this
@@ -91,9 +105,9 @@ public:
     // raw pointer: function(ptr)
     // member function: bind(&func, ...)
     template<typename Func>
-    std::future<typename std::invoke_result_t<Func()>::result_type> 
+    std::future<std::invoke_result_t<Func> > 
         submit(Func f) {
-        using ResultType = std::invoke_result_t<Func()>::result_type;
+        using ResultType = std::invoke_result_t<Func>;
         
         // function -> packaged_task<param> -> FunctionWrapper -> call
         std::packaged_task<ResultType()> task(std::move(f));
@@ -153,9 +167,9 @@ public:
     // raw pointer: function(ptr)
     // member function: bind(&func, ...)
     template<typename Func>
-    std::future<typename std::invoke_result_t<Func()>::result_type> 
+    std::future<std::invoke_result_t<Func> > 
         submit(Func f) {
-        using ResultType = std::invoke_result_t<Func()>::result_type;
+        using ResultType = std::invoke_result_t<Func>;
         
         // function -> packaged_task<param> -> FunctionWrapper -> call
         std::packaged_task<ResultType()> task(std::move(f));
@@ -192,4 +206,123 @@ private:
     JoinThreads joiner;
 };
 
+// pool behind the parallel algorithms.
+// idle workers sleep on the queue instead of spinning, and a thread that
+// waits for a future through wait() runs pending tasks meanwhile, so tasks
+// may submit and wait for subtasks without dead lock.
+class ThreadPool {
+public:
+    // num_threads <= 0 means one worker per hardware thread
+    explicit ThreadPool(int num_threads = 0):joiner(threads) {
+        if(num_threads <= 0) {
+            num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+        try {
+            for(int i = 0; i < num_threads; i++) {
+                threads.emplace_back(std::thread(
+                    &ThreadPool::do_work_per_thread,
+                    this,
+                    i + 1
+                ));
+            }
+        } catch(...) {
+            stop();
+            throw;
+        }
+    }
+
+    ~ThreadPool() {
+        stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename Func>
+    std::future<std::invoke_result_t<Func> >
+        submit(Func f) {
+        using ResultType = std::invoke_result_t<Func>;
+
+        std::packaged_task<ResultType()> task(std::move(f));
+        std::future<ResultType> result = task.get_future();
+        queue.push(FunctionWrapper(std::move(task)));
+        return result;
+    }
+
+    // returns false if there was nothing to run
+    bool run_pending_task() {
+        FunctionWrapper task;
+        if(!queue.try_pop(task)) {
+            return false;
+        }
+        if(!task) {
+            // a stop marker, it belongs to a worker
+            queue.push(std::move(task));
+            return false;
+        }
+        task();
+        return true;
+    }
+
+    // helps with pending tasks until the future is ready
+    template<typename T>
+    void wait(std::future<T>& future) {
+        while(future.wait_for(std::chrono::seconds(0)) == std::future_status::timeout) {
+            if(!run_pending_task()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    int size() const {
+        return (int)threads.size();
+    }
+
+    // 1..size() on this pool's workers, 0 on any other thread
+    int current_worker() const {
+        return worker_pool() == this ? worker_index() : 0;
+    }
+
+    // shared by the parallel algorithms unless they are given a pool
+    static ThreadPool& default_pool() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    void stop() {
+        // one empty task per worker, queued behind the pending work
+        for(size_t i = 0; i < threads.size(); i++) {
+            queue.push(FunctionWrapper());
+        }
+    }
+
+    static const ThreadPool*& worker_pool() {
+        thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& worker_index() {
+        thread_local int index = 0;
+        return index;
+    }
+
+    void do_work_per_thread(int index) {
+        worker_pool() = this;
+        worker_index() = index;
+        while(true) {
+            FunctionWrapper task;
+            queue.wait_and_pop(task);
+            if(!task) {
+                return;
+            }
+            task();
+        }
+    }
+
+    FineGrainedLockQueue<FunctionWrapper> queue;
+    std::vector<std::thread> threads;
+    JoinThreads joiner;
+};
+
 #endif
@@ -1,13 +1,26 @@
 #ifndef THREADSAFEHASHTABLE_H
 #define THREADSAFEHASHTABLE_H
 
+#include "ThreadPool.h"
+#include "Partitioner.h"
+#include "CacheLine.h"
+#include "LockTraits.h"
+#include "LockProfiler.h"
 #include <shared_mutex>
+#include <mutex>
+#include <thread>
 #include <list>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 #include <optional>
 
-template<typename K, typename V, typename Hash=std::hash<K> >
+// buckets hold no lock themselves, bucket i is guarded by stripe
+// i % num_stripes. stripes live in their own cache aligned array, so
+// the lock count is independent of the bucket count and neighbouring
+// locks never share a cache line.
+// Mutex may be exclusive only (e.g. SpinLockMutex), reads then lock exclusively.
+template<typename K, typename V, typename Hash=std::hash<K>, typename Mutex=std::shared_mutex>
 class ThreadSafeHashTable {
 private:
 	class BucketType {
@@ -18,7 +31,6 @@ private:
 
 	public:
 		std::optional<V> get(const K& key) {
-			std::shared_lock<std::shared_mutex> lk(mut);
 			BucketIterator found_entry = find_entry(key);
 			std::optional<V> opt_value;
 			if (found_entry != data.end()) {
@@ -28,7 +40,6 @@ private:
 		}
 
 		void insert_or_update(const K& key, const V& value) {
-			std::unique_lock<std::shared_mutex> lk(mut);
 			BucketIterator found_entry = find_entry(key);
 			if (found_entry == data.end()) {
 				data.push_back(BucketValue(key, value));
@@ -39,13 +50,37 @@ private:
 		}
 
 		void erase(const K& key) {
-			std::unique_lock<std::shared_mutex> lk(mut);
 			BucketIterator found_entry = find_entry(key);
 			if (found_entry != data.end()) {
 				data.erase(found_entry);
 			}
 		}
 
+		template<typename Func>
+		void for_each(Func& f) const {
+			for (const BucketValue& item : data) {
+				f(item.first, item.second);
+			}
+		}
+
+		std::size_t size() const {
+			return data.size();
+		}
+
+		template<typename Iterator>
+		void insert_all(Iterator first, Iterator last) {
+			// an empty bucket needs no lookup, this is the warm start path
+			bool was_empty = data.empty();
+			for (; first != last; ++first) {
+				if (was_empty) {
+					data.push_back(BucketValue(first->first, first->second));
+				}
+				else {
+					insert_or_update(first->first, first->second);
+				}
+			}
+		}
+
 	private:
 		BucketIterator find_entry(const K& key) {
 			return std::find_if(data.begin(), data.end(), [&](const BucketValue& item) {
@@ -54,33 +89,137 @@ private:
 		}
 
 		BucketData data;
-		mutable std::shared_mutex mut;
 	};
+
+	typedef CacheAligned<Mutex> LockStripe;
+
 public:
-	ThreadSafeHashTable(int num_buckets = 17, const Hash& hasher_ = Hash()) :
-	buckets(num_buckets), hasher(hasher_)
+	// num_stripes <= 0 sizes the stripes to the core count
+	ThreadSafeHashTable(int num_buckets = 17, const Hash& hasher_ = Hash(), int num_stripes = 0) :
+	buckets(num_buckets), stripes(default_stripes(num_buckets, num_stripes)), hasher(hasher_)
 	{
-
+		for (LockStripe& stripe : stripes) {
+			name_lock_site(stripe.value, "ThreadSafeHashTable.stripe");
+		}
 	}
 
 	std::optional<V> get(const K& key) {
-		return buckets[get_hash(key)].get(key);
+		std::size_t index = get_hash(key);
+		ReadLockGuard<Mutex> lk(get_stripe(index));
+		return buckets[index].get(key);
 	}
 
 	void insert_or_update(const K& key, const V& value) {
-		buckets[get_hash(key)].insert_or_update(key, value);
+		std::size_t index = get_hash(key);
+		std::lock_guard<Mutex> lk(get_stripe(index));
+		buckets[index].insert_or_update(key, value);
 	}
 
 	void erase(const K& key) {
-		buckets[get_hash(key)].erase(key);
+		std::size_t index = get_hash(key);
+		std::lock_guard<Mutex> lk(get_stripe(index));
+		buckets[index].erase(key);
+	}
+
+	int num_stripes() const {
+		return (int)stripes.size();
+	}
+
+	std::size_t bucket_count() const {
+		return buckets.size();
+	}
+
+	std::size_t bucket_index(const K& key) const {
+		return get_hash(key);
+	}
+
+	// f(key, value) for every entry of one bucket, under its stripe lock
+	template<typename Func>
+	void for_each_in_bucket(std::size_t bucket_index, Func f) const {
+		visit_bucket(bucket_index, f);
+	}
+
+	// insert a run of (key, value) pairs under a single lock,
+	// every key must hash to bucket_index, keys must be unique in the run
+	template<typename Iterator>
+	void insert_into_bucket(std::size_t bucket_index, Iterator first, Iterator last) {
+		std::lock_guard<Mutex> lk(get_stripe(bucket_index));
+		buckets[bucket_index].insert_all(first, last);
+	}
+
+	// consistency: every bucket is visited under its own shared lock, so the
+	// entries of one bucket are seen atomically, but the walk as a whole is
+	// not a point-in-time view. writers on other buckets are never blocked.
+	template<typename Func>
+	void for_each(Func f) const {
+		for (std::size_t i = 0; i < buckets.size(); i++) {
+			visit_bucket(i, f);
+		}
+	}
+
+	// same consistency as for_each, may be stale under concurrent writes
+	std::size_t size() const {
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < buckets.size(); i++) {
+			ReadLockGuard<Mutex> lk(get_stripe(i));
+			count += buckets[i].size();
+		}
+		return count;
+	}
+
+	std::unordered_map<K, V, Hash> snapshot() const {
+		std::unordered_map<K, V, Hash> result(buckets.size(), hasher);
+		for_each([&result](const K& key, const V& value) {
+			result.emplace(key, value);
+		});
+		return result;
+	}
+
+	std::vector<std::pair<K, V> > snapshot_entries() const {
+		std::vector<std::pair<K, V> > result;
+		for_each([&result](const K& key, const V& value) {
+			result.emplace_back(key, value);
+		});
+		return result;
+	}
+
+	// buckets are split into chunks run on pool, see Partitioner.h.
+	// f must be safe to call concurrently, keys of one bucket are always
+	// passed to f from the same thread.
+	template<typename Func, typename Partitioner = AutoPartitioner>
+	void parallel_for_each(Func f, const Partitioner& partitioner = Partitioner(),
+		ThreadPool& pool = ThreadPool::default_pool()) const {
+		parallel_for_range(buckets.size(), [this, &f](std::size_t begin, std::size_t end) {
+			for (; begin < end; begin++) {
+				visit_bucket(begin, f);
+			}
+		}, partitioner, pool);
 	}
 
 private:
+	static std::size_t default_stripes(int num_buckets, int num_stripes) {
+		if (num_stripes <= 0) {
+			num_stripes = 4 * std::max(1, (int)std::thread::hardware_concurrency());
+		}
+		return std::max(1, std::min(num_stripes, num_buckets));
+	}
+
 	std::size_t get_hash(const K& key) const {
 		return hasher(key) % buckets.size();
 	}
 
+	Mutex& get_stripe(std::size_t bucket_index) const {
+		return stripes[bucket_index % stripes.size()].value;
+	}
+
+	template<typename Func>
+	void visit_bucket(std::size_t bucket_index, Func& f) const {
+		ReadLockGuard<Mutex> lk(get_stripe(bucket_index));
+		buckets[bucket_index].for_each(f);
+	}
+
 	std::vector<BucketType> buckets;
+	mutable std::vector<LockStripe> stripes;
 	Hash hasher;
 };
 
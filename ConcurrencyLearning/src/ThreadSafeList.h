@@ -1,25 +1,40 @@
 #ifndef THREADSAFELIST_H
 #define THREADSAFELIST_H
 
+#include "EpochReclamation.h"
+#include "SpinLockMutex.h"
+#include "SlabPool.h"
+#include "LockProfiler.h"
 #include <mutex>
+#include <atomic>
 #include <optional>
+#include <cstdint>
+#include <new>
+#include <utility>
 
-template<typename T>
+template<typename T, typename Mutex = std::mutex>
 class ThreadSafeList {
 private:
     struct Node {
-        std::mutex mut;
+        Mutex mut;
         T data;
         Node* next;
 
         Node(): 
         next(nullptr) {
-
+            name_lock_site(mut, site());
         }
 
         Node(const T& value):
         data(value), next(nullptr) {
+            name_lock_site(mut, site());
+        }
 
+        // resolved once, every push would otherwise look it up
+        // under the profiler's lock
+        static LockSiteStats* site() {
+            static LockSiteStats* const node_site = lock_site("ThreadSafeList.node");
+            return node_site;
         }
     };
 
@@ -36,7 +51,7 @@ public:
 
     void push_front(const T& value) {
         Node* new_node = new Node(value);
-        std::lock_guard<std::mutex> lk(head.mut);
+        std::lock_guard<Mutex> lk(head.mut);
         new_node->next = head.next;
         head.next = new_node;
     }
@@ -44,9 +59,9 @@ public:
     template<typename Func>
     void for_each(Func f) {
         Node* curr = &head;
-        std::unique_lock<std::mutex> curr_lk(curr->mut);
+        std::unique_lock<Mutex> curr_lk(curr->mut);
         while(Node* next = curr->next) {
-            std::unique_lock<std::mutex> next_lk(next->mut);
+            std::unique_lock<Mutex> next_lk(next->mut);
             curr_lk.unlock();
             f(next->data);
             curr = next;
@@ -58,9 +73,9 @@ public:
     std::optional<T> find_first_if(Pred p) {
         Node* curr = &head;
         std::optional<T> opt_value;
-        std::unique_lock<std::mutex> curr_lk(curr->mut);
+        std::unique_lock<Mutex> curr_lk(curr->mut);
         while(Node* next = curr->next) {
-            std::unique_lock<std::mutex> next_lk(next->mut);
+            std::unique_lock<Mutex> next_lk(next->mut);
             curr_lk.unlock();
             if(p(next->data)) {
                 opt_value = next->data;
@@ -75,9 +90,9 @@ public:
     template<typename Pred>
     void remove_if(Pred p) {
         Node* curr = &head;
-        std::unique_lock<std::mutex> curr_lk(curr->mut);
+        std::unique_lock<Mutex> curr_lk(curr->mut);
         while(Node* next = curr->next) {
-            std::unique_lock<std::mutex> next_lk(next->mut);
+            std::unique_lock<Mutex> next_lk(next->mut);
 
             if(p(next->data)) {
                 Node* old_next = std::move(next);
@@ -96,4 +111,266 @@ private:
     Node head;
 };
 
+// lazy list variant for read heavy use:
+// readers never lock, they skip nodes whose marked flag is set.
+// writers lock only pred and curr, then validate that both are still
+// unmarked and adjacent before unlinking. a removed node is marked before
+// it is unlinked, and freed through EpochManager once no reader can hold it.
+// elements are read only once inserted, for_each passes const T&.
+template<typename T, typename Mutex = std::mutex>
+class LazyThreadSafeList {
+private:
+    struct Node {
+        Mutex mut;
+        T data;
+        std::atomic<Node*> next;
+        std::atomic<bool> marked;
+
+        Node():
+        next(nullptr), marked(false) {
+            name_lock_site(mut, site());
+        }
+
+        Node(const T& value):
+        data(value), next(nullptr), marked(false) {
+            name_lock_site(mut, site());
+        }
+
+        static LockSiteStats* site() {
+            static LockSiteStats* const node_site = lock_site("LazyThreadSafeList.node");
+            return node_site;
+        }
+    };
+
+public:
+    LazyThreadSafeList() {
+
+    }
+
+    ~LazyThreadSafeList() {
+        Node* curr = head.next.load();
+        while(curr) {
+            Node* next = curr->next.load();
+            delete curr;
+            curr = next;
+        }
+    }
+
+    void push_front(const T& value) {
+        Node* new_node = new Node(value);
+        std::lock_guard<Mutex> lk(head.mut);
+        new_node->next.store(head.next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head.next.store(new_node, std::memory_order_release);
+    }
+
+    template<typename Func>
+    void for_each(Func f) const {
+        EpochGuard guard;
+        for(Node* curr = head.next.load(std::memory_order_acquire); curr;
+            curr = curr->next.load(std::memory_order_acquire)) {
+            if(!curr->marked.load(std::memory_order_acquire)) {
+                f(static_cast<const T&>(curr->data));
+            }
+        }
+    }
+
+    template<typename Pred>
+    std::optional<T> find_first_if(Pred p) const {
+        EpochGuard guard;
+        std::optional<T> opt_value;
+        for(Node* curr = head.next.load(std::memory_order_acquire); curr;
+            curr = curr->next.load(std::memory_order_acquire)) {
+            if(!curr->marked.load(std::memory_order_acquire) && p(static_cast<const T&>(curr->data))) {
+                opt_value = curr->data;
+                return opt_value;
+            }
+        }
+        return opt_value;
+    }
+
+    template<typename Pred>
+    void remove_if(Pred p) {
+        EpochGuard guard;
+        Node* pred = &head;
+        Node* curr = pred->next.load(std::memory_order_acquire);
+        while(curr) {
+            if(!p(static_cast<const T&>(curr->data))) {
+                pred = curr;
+                curr = curr->next.load(std::memory_order_acquire);
+                continue;
+            }
+
+            bool removed = false;
+            {
+                std::lock_guard<Mutex> pred_lk(pred->mut);
+                std::lock_guard<Mutex> curr_lk(curr->mut);
+                if(validate(pred, curr)) {
+                    curr->marked.store(true, std::memory_order_release);
+                    pred->next.store(curr->next.load(std::memory_order_relaxed), std::memory_order_release);
+                    removed = true;
+                }
+            }
+            if(removed) {
+                EpochManager::instance().retire(curr);
+            } else if(pred->marked.load(std::memory_order_acquire)) {
+                // pred left the list under us, start over
+                pred = &head;
+            }
+            curr = pred->next.load(std::memory_order_acquire);
+        }
+    }
+
+private:
+    static bool validate(Node* pred, Node* curr) {
+        return !pred->marked.load(std::memory_order_relaxed) &&
+            !curr->marked.load(std::memory_order_relaxed) &&
+            pred->next.load(std::memory_order_relaxed) == curr;
+    }
+
+    Node head;
+};
+
+// memory lean variant of ThreadSafeList for many small elements:
+// the per node lock is a single byte ByteSpinLock instead of a std::mutex,
+// nodes come from a per list SlabPool, and every node holds up to
+// NodeCapacity elements (an unrolled list). NodeCapacity = 1 keeps one
+// element per node. locking is hand-over-hand per node as in ThreadSafeList.
+// elements are visited newest first, like ThreadSafeList.
+template<typename T, int NodeCapacity = 1>
+class CompactThreadSafeList {
+private:
+    static_assert(NodeCapacity >= 1 && NodeCapacity <= 65535, "NodeCapacity must fit in 16 bits");
+
+    struct Node {
+        Node* next;
+        alignas(T) unsigned char storage[sizeof(T) * NodeCapacity];
+        std::uint16_t count;
+        ByteSpinLock mut;
+
+        Node():
+        next(nullptr), count(0) {
+
+        }
+
+        T* items() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+public:
+    CompactThreadSafeList() {
+
+    }
+
+    ~CompactThreadSafeList() {
+        remove_if([](const T&) {
+            return true;
+        });
+    }
+
+    void push_front(const T& value) {
+        std::unique_lock<ByteSpinLock> head_lk(head.mut);
+        Node* first = head.next;
+        if(NodeCapacity > 1 && first) {
+            std::lock_guard<ByteSpinLock> first_lk(first->mut);
+            if(first->count < NodeCapacity) {
+                new (&first->items()[first->count]) T(value);
+                first->count++;
+                return;
+            }
+        }
+        Node* new_node = new (pool.allocate()) Node;
+        new (new_node->items()) T(value);
+        new_node->count = 1;
+        new_node->next = first;
+        head.next = new_node;
+    }
+
+    template<typename Func>
+    void for_each(Func f) {
+        Node* curr = &head;
+        std::unique_lock<ByteSpinLock> curr_lk(curr->mut);
+        while(Node* next = curr->next) {
+            std::unique_lock<ByteSpinLock> next_lk(next->mut);
+            curr_lk.unlock();
+            T* items = next->items();
+            for(int i = next->count - 1; i >= 0; i--) {
+                f(items[i]);
+            }
+            curr = next;
+            curr_lk = std::move(next_lk);
+        }
+    }
+
+    template<typename Pred>
+    std::optional<T> find_first_if(Pred p) {
+        Node* curr = &head;
+        std::optional<T> opt_value;
+        std::unique_lock<ByteSpinLock> curr_lk(curr->mut);
+        while(Node* next = curr->next) {
+            std::unique_lock<ByteSpinLock> next_lk(next->mut);
+            curr_lk.unlock();
+            T* items = next->items();
+            for(int i = next->count - 1; i >= 0; i--) {
+                if(p(items[i])) {
+                    opt_value = items[i];
+                    return opt_value;
+                }
+            }
+            curr = next;
+            curr_lk = std::move(next_lk);
+        }
+        return opt_value;
+    }
+
+    template<typename Pred>
+    void remove_if(Pred p) {
+        Node* curr = &head;
+        std::unique_lock<ByteSpinLock> curr_lk(curr->mut);
+        while(Node* next = curr->next) {
+            std::unique_lock<ByteSpinLock> next_lk(next->mut);
+            remove_items(next, p);
+
+            if(next->count == 0) {
+                curr->next = next->next;
+                next_lk.unlock();
+                next->~Node();
+                pool.deallocate(next);
+            } else {
+                curr_lk.unlock();
+                curr = next;
+                curr_lk = std::move(next_lk);
+            }
+        }
+    }
+
+    // bytes per node including its share of the lock and the link
+    static constexpr std::size_t node_size() {
+        return sizeof(Node);
+    }
+
+private:
+    // destroy the matches and slide the survivors down, keeping their order
+    template<typename Pred>
+    static void remove_items(Node* node, Pred& p) {
+        T* items = node->items();
+        int kept = 0;
+        for(int i = 0; i < node->count; i++) {
+            if(p(items[i])) {
+                items[i].~T();
+            } else {
+                if(kept != i) {
+                    new (&items[kept]) T(std::move(items[i]));
+                    items[i].~T();
+                }
+                kept++;
+            }
+        }
+        node->count = (std::uint16_t)kept;
+    }
+
+    Node head;
+    SlabPool<Node> pool;
+};
+
 #endif
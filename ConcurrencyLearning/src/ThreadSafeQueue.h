@@ -4,16 +4,19 @@
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <type_traits>
+#include "LockProfiler.h"
 
-template<typename T>
+// Mutex is any Lockable, std::condition_variable is only used with std::mutex
+template<typename T, typename Mutex = std::mutex>
 class ThreadSafeQueue {
 public:
 	ThreadSafeQueue() {
-
+		name_lock_site(mut, "ThreadSafeQueue.mut");
 	}
 
 	void wait_and_pop(T& value) {
-		std::unique_lock<std::mutex> lk(mut);
+		std::unique_lock<Mutex> lk(mut);
 		data_cv.wait(lk, [this]() {
 			return !data_queue.empty();
 		});
@@ -23,7 +26,7 @@ public:
 	}
 
 	bool try_pop(T& value) {
-		std::lock_guard<std::mutex> lk(mut);
+		std::lock_guard<Mutex> lk(mut);
 		if (data_queue.empty()) {
 			return false;
 		}
@@ -33,25 +36,26 @@ public:
 	}
 
 	void push(const T& value) {
-		std::lock_guard<std::mutex> lk(mut);
+		std::lock_guard<Mutex> lk(mut);
 		data_queue.push(value);
 		data_cv.notify_one();
 	}
 
 	bool empty() const {
-		std::lock_guard<std::mutex> lk(mut);
+		std::lock_guard<Mutex> lk(mut);
 		return data_queue.empty();
 	}
 
 	int size() const {
-		std::lock_guard<std::mutex> lk(mut);
+		std::lock_guard<Mutex> lk(mut);
 		return (int)data_queue.size();
 	}
 
 private:
 	std::queue<T> data_queue;
-	mutable std::mutex mut;		// use in const function
-	std::condition_variable data_cv;
+	mutable Mutex mut;		// use in const function
+	std::conditional_t<std::is_same<Mutex, std::mutex>::value,
+		std::condition_variable, std::condition_variable_any> data_cv;
 };
 
 #endif // !THREADSAFEQUEUE_H
@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+#include "AdaptiveMutex.h"
+#include "ThreadSafeHashTable.h"
+#include "ThreadSafeQueue.h"
+#include "FineGrainedLockQueue.h"
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <iostream>
+
+template<typename Mutex>
+long long contended_add_us(Mutex& mutex, int num_threads, int steps_per_thread, long long& value) {
+	std::vector<std::thread> tids;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&mutex, &value, steps_per_thread]() {
+			for (int k = 0; k < steps_per_thread; k++) {
+				std::lock_guard<Mutex> lk(mutex);
+				value++;
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(AdaptiveMutexTest, ManyThreadAdd) {
+	AdaptiveMutex mutex;
+	long long value = 0;
+	contended_add_us(mutex, 8, 20000, value);
+	EXPECT_EQ(value, 8 * 20000);
+
+	// no spinning at all, every contended waiter parks right away
+	AdaptiveMutex parking_mutex(0);
+	value = 0;
+	contended_add_us(parking_mutex, 8, 20000, value);
+	EXPECT_EQ(value, 8 * 20000);
+}
+
+TEST(AdaptiveMutexTest, HolderSleeps) {
+	// waiters must park and be woken while the holder is off cpu
+	AdaptiveMutex mutex;
+	int value = 0;
+	std::vector<std::thread> tids;
+	for (int i = 0; i < 4; i++) {
+		tids.emplace_back([&mutex, &value]() {
+			for (int k = 0; k < 20; k++) {
+				std::lock_guard<AdaptiveMutex> lk(mutex);
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				value++;
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	EXPECT_EQ(value, 4 * 20);
+}
+
+TEST(AdaptiveMutexTest, TryLock) {
+	AdaptiveMutex mutex;
+	ASSERT_TRUE(mutex.try_lock());
+	EXPECT_FALSE(mutex.try_lock());
+	mutex.unlock();
+	EXPECT_TRUE(mutex.try_lock());
+	mutex.unlock();
+}
+
+TEST(AdaptiveMutexTest, DropInForContainers) {
+	ThreadSafeHashTable<int, int, std::hash<int>, AdaptiveMutex> hash_table;
+	ThreadSafeQueue<int, AdaptiveMutex> queue;
+	FineGrainedLockQueue<int, AdaptiveMutex> fine_queue;
+	int num_values = 2000;
+
+	std::thread producer([&]() {
+		for (int i = 0; i < num_values; i++) {
+			hash_table.insert_or_update(i, i);
+			queue.push(i);
+			fine_queue.push(i);
+		}
+	});
+	long long sum = 0, fine_sum = 0;
+	for (int i = 0; i < num_values; i++) {
+		int value;
+		queue.wait_and_pop(value);
+		sum += value;
+		while (!fine_queue.try_pop(value)) {
+			std::this_thread::yield();
+		}
+		fine_sum += value;
+	}
+	producer.join();
+
+	EXPECT_EQ(sum, (long long)num_values * (num_values - 1) / 2);
+	EXPECT_EQ(fine_sum, sum);
+	EXPECT_EQ(hash_table.size(), num_values);
+	EXPECT_TRUE(queue.empty());
+}
+
+TEST(AdaptiveMutexTest, ContentionBenchmark) {
+	int steps_per_thread = 20000;
+	int max_threads = std::max(16, 2 * (int)std::thread::hardware_concurrency());
+	for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		long long value = 0;
+		AdaptiveMutex adaptive;
+		TTASSpinLock ttas;
+		std::mutex std_mutex;
+		long long adaptive_us = contended_add_us(adaptive, num_threads, steps_per_thread, value);
+		long long ttas_us = contended_add_us(ttas, num_threads, steps_per_thread, value);
+		long long mutex_us = contended_add_us(std_mutex, num_threads, steps_per_thread, value);
+		EXPECT_EQ(value, 3LL * num_threads * steps_per_thread);
+		std::cout << "threads: " << num_threads
+			<< ", AdaptiveMutex: " << adaptive_us << "us"
+			<< ", TTASSpinLock: " << ttas_us << "us"
+			<< ", std::mutex: " << mutex_us << "us" << std::endl;
+	}
+}
@@ -0,0 +1,111 @@
+#include "BlockedRange.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+TEST(BlockedRangeTest, TilesCoverTheGridOnce) {
+    struct Shape {
+        std::size_t rows, cols, tile_rows, tile_cols;
+    };
+    for(Shape shape : {Shape{0, 5, 2, 2}, Shape{1, 1, 4, 4}, Shape{7, 13, 3, 5}, Shape{64, 64, 16, 16},
+        Shape{10, 3, 100, 1}, Shape{5, 5, 0, 0}}) {
+        BlockedRange2d range(shape.rows, shape.cols, shape.tile_rows, shape.tile_cols);
+        std::vector<std::atomic<int> > visits(shape.rows * shape.cols);
+        std::atomic<std::size_t> tiles(0);
+        parallel_for(range, [&](const Range2d& tile) {
+            tiles++;
+            EXPECT_LE(tile.rows(), std::max<std::size_t>(1, shape.tile_rows));
+            EXPECT_LE(tile.cols(), std::max<std::size_t>(1, shape.tile_cols));
+            for(std::size_t r = tile.row_begin; r < tile.row_end; r++) {
+                for(std::size_t c = tile.col_begin; c < tile.col_end; c++) {
+                    visits[r * shape.cols + c]++;
+                }
+            }
+        }, SimplePartitioner(2));
+        EXPECT_EQ(tiles.load(), range.num_tiles());
+        for(auto&& v : visits) {
+            ASSERT_EQ(v.load(), 1);
+        }
+    }
+
+    BlockedRange2d square(10, 20, 4);
+    EXPECT_EQ(square.num_tiles(), 3u * 5u);
+    Range2d last = square.tile(square.num_tiles() - 1);
+    EXPECT_EQ(last.row_begin, 8u);
+    EXPECT_EQ(last.row_end, 10u);
+    EXPECT_EQ(last.col_begin, 16u);
+    EXPECT_EQ(last.col_end, 20u);
+}
+
+// one jacobi sweep of a 5 point stencil from in to out, over the tile
+static void stencil(const std::vector<float>& in, std::vector<float>& out, std::size_t cols, const Range2d& tile) {
+    for(std::size_t r = tile.row_begin; r < tile.row_end; r++) {
+        const float* above = &in[(r - 1) * cols];
+        const float* row = &in[r * cols];
+        const float* below = &in[(r + 1) * cols];
+        float* result = &out[r * cols];
+        for(std::size_t c = tile.col_begin; c < tile.col_end; c++) {
+            result[c] = 0.2f * (row[c] + row[c - 1] + row[c + 1] + above[c] + below[c]);
+        }
+    }
+}
+
+TEST(BlockedRangeTest, StencilAffinityMatchesAndBenchmark) {
+    std::size_t n = 1024;
+    int sweeps = 8;
+    std::vector<float> grid(n * n);
+    for(std::size_t i = 0; i < grid.size(); i++) {
+        grid[i] = (float)(i % 97);
+    }
+    // the border stays fixed
+    BlockedRange2d interior(n - 2, n - 2, 64);
+    auto shifted = [](Range2d tile) {
+        return Range2d{tile.row_begin + 1, tile.row_end + 1, tile.col_begin + 1, tile.col_end + 1};
+    };
+
+    auto run_per_element = [&]() {
+        std::vector<float> a = grid, b = grid;
+        for(int s = 0; s < sweeps; s++) {
+            parallel_for_range((n - 2) * (n - 2), [&](std::size_t begin, std::size_t end) {
+                for(; begin < end; begin++) {
+                    std::size_t r = begin / (n - 2) + 1, c = begin % (n - 2) + 1;
+                    stencil(a, b, n, Range2d{r, r + 1, c, c + 1});
+                }
+            });
+            a.swap(b);
+        }
+        return a;
+    };
+    auto run_tiled = [&](auto partitioner) {
+        std::vector<float> a = grid, b = grid;
+        for(int s = 0; s < sweeps; s++) {
+            parallel_for(interior, [&](const Range2d& tile) {
+                stencil(a, b, n, shifted(tile));
+            }, partitioner);
+            a.swap(b);
+        }
+        return a;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<float> expect = run_per_element();
+    auto element_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<float> tiled = run_tiled(AutoPartitioner());
+    auto tiled_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<float> affinity = run_tiled(AffinityPartitioner());
+    auto affinity_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(tiled, expect);
+    EXPECT_EQ(affinity, expect);
+    std::cout << sweeps << " stencil sweeps over " << n << "x" << n << ": per element "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(element_time).count() << "ms, 64x64 tiles "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(tiled_time).count() << "ms, tiles with affinity "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(affinity_time).count() << "ms" << std::endl;
+}
@@ -0,0 +1,164 @@
+#include "ExecutionPolicy.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::vector<ExecutionPolicy> all_policies(ThreadPool& pool) {
+    std::vector<ExecutionPolicy> policies = {
+        ExecutionPolicy::sequential(),
+        ExecutionPolicy::vectorized(),
+        ExecutionPolicy::async(),
+        ExecutionPolicy::threads(),
+        ExecutionPolicy::pool(pool),
+    };
+    // the tests are about the strategies, not the threshold
+    for(auto&& policy : policies) {
+        policy = policy.with_sequential_threshold(0);
+    }
+    return policies;
+}
+
+TEST(ExecutionPolicyTest, FromName) {
+    for(std::string name : {"sequential", "vectorized", "async", "threads", "pool"}) {
+        std::optional<ExecutionPolicy> policy = ExecutionPolicy::from_name(name);
+        ASSERT_TRUE(policy);
+        EXPECT_EQ(policy->name(), name);
+        EXPECT_EQ(policy->thread_pool() != nullptr, name == "pool");
+    }
+    EXPECT_FALSE(ExecutionPolicy::from_name("gpu"));
+    EXPECT_EQ(ExecutionPolicy::from_name("pool")->thread_pool(), &ThreadPool::default_pool());
+}
+
+TEST(ExecutionPolicyTest, EveryPolicyMatchesStd) {
+    ThreadPool pool(3);
+    srand(234);
+    for(int length : {0, 1, 7, 1000, 10007}) {
+        std::vector<int> values(length);
+        for(auto&& v : values) {
+            v = rand() % 1000;
+        }
+        std::vector<int> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        long long sum = std::accumulate(values.begin(), values.end(), 0ll);
+        int target = length ? values[length * 2 / 3] : 0;
+        auto target_it = std::find(values.begin(), values.end(), target);
+
+        for(auto&& policy : all_policies(pool)) {
+            SCOPED_TRACE(policy.name());
+            std::vector<int> visited(length, 0);
+            parallel_for_each(policy, visited.begin(), visited.end(), [](int& v) {
+                v++;
+            });
+            EXPECT_EQ(std::count(visited.begin(), visited.end(), 1), length);
+
+            EXPECT_EQ(parallel_find_first(policy, values.begin(), values.end(), target), target_it);
+            EXPECT_EQ(parallel_find_first(policy, values.begin(), values.end(), -1), values.end());
+            EXPECT_EQ(parallel_find_if(policy, values.begin(), values.end(), [](int v) {
+                return v > 990;
+            }), std::find_if(values.begin(), values.end(), [](int v) {
+                return v > 990;
+            }));
+
+            EXPECT_EQ(parallel_accumulate(policy, values.begin(), values.end(), 0ll), sum);
+            EXPECT_EQ(parallel_accumulate(policy, values.begin(), values.end(), 5), (int)sum + 5);
+            EXPECT_EQ(parallel_reduce(policy, values.begin(), values.end(), 0, [](int lhs, int rhs) {
+                return std::max(lhs, rhs);
+            }), length ? sorted.back() : 0);
+
+            std::vector<int> doubled(length);
+            EXPECT_EQ(parallel_transform(policy, values.begin(), values.end(), doubled.begin(), [](int v) {
+                return v * 2;
+            }), doubled.end());
+            for(int i = 0; i < length; i++) {
+                ASSERT_EQ(doubled[i], values[i] * 2);
+            }
+
+            std::vector<int> copy = values;
+            parallel_sort(policy, copy.begin(), copy.end());
+            EXPECT_EQ(copy, sorted);
+            parallel_sort(policy, copy.begin(), copy.end(), std::greater<>());
+            EXPECT_TRUE(std::is_sorted(copy.begin(), copy.end(), std::greater<>()));
+        }
+    }
+}
+
+TEST(ExecutionPolicyTest, NonCommutativeReduceKeepsOrder) {
+    ThreadPool pool(3);
+    std::vector<std::string> letters(20000);
+    std::string expect = ">";
+    for(std::size_t i = 0; i < letters.size(); i++) {
+        letters[i] = std::string(1, (char)('a' + i % 26));
+        expect += letters[i];
+    }
+    // associative, not commutative
+    auto concat = [](std::string lhs, const std::string& rhs) {
+        lhs += rhs;
+        return lhs;
+    };
+    for(auto&& policy : all_policies(pool)) {
+        SCOPED_TRACE(policy.name());
+        for(int run = 0; run < 20; run++) {
+            ASSERT_EQ(parallel_reduce(policy, letters.begin(), letters.end(), std::string(">"), concat), expect);
+        }
+    }
+}
+
+TEST(ExecutionPolicyTest, ShortRangesRunSequentially) {
+    auto thread_ids = [](const ExecutionPolicy& policy, std::size_t length) {
+        std::mutex mut;
+        std::set<std::thread::id> ids;
+        std::vector<int> values(length);
+        parallel_for_each(policy, values.begin(), values.end(), [&](int) {
+            std::lock_guard<std::mutex> lk(mut);
+            ids.insert(std::this_thread::get_id());
+        });
+        return ids;
+    };
+
+    ExecutionPolicy policy = ExecutionPolicy::threads().with_sequential_threshold(100);
+    EXPECT_EQ(policy.kind_for(99), ExecutionPolicy::Kind::SEQUENTIAL);
+    EXPECT_EQ(policy.kind_for(100), ExecutionPolicy::Kind::THREADS);
+    EXPECT_EQ(ExecutionPolicy::vectorized().kind_for(1), ExecutionPolicy::Kind::VECTORIZED);
+
+    std::set<std::thread::id> ids = thread_ids(policy, 99);
+    EXPECT_EQ(ids, std::set<std::thread::id>{std::this_thread::get_id()});
+    // every thread has a block of its own
+    EXPECT_GE(thread_ids(policy, 1000).size(), 2u);
+}
+
+TEST(ExecutionPolicyTest, ExceptionPropagates) {
+    ThreadPool pool(2);
+    std::vector<int> values(1000, 0);
+    values[700] = 1;
+    for(auto&& policy : all_policies(pool)) {
+        SCOPED_TRACE(policy.name());
+        EXPECT_THROW(parallel_for_each(policy, values.begin(), values.end(), [](int v) {
+            if(v) {
+                throw std::runtime_error("bad element");
+            }
+        }), std::runtime_error);
+    }
+}
+
+TEST(ExecutionPolicyTest, Benchmark) {
+    std::vector<int> values(1000000);
+    std::iota(values.begin(), values.end(), 0);
+    for(auto&& policy : all_policies(ThreadPool::default_pool())) {
+        auto start = std::chrono::steady_clock::now();
+        long long sum = parallel_accumulate(policy, values.begin(), values.end(), 0ll);
+        auto time = std::chrono::steady_clock::now() - start;
+        EXPECT_EQ(sum, 499999500000ll);
+        std::cout << "accumulate of " << values.size() << " ints, " << policy.name() << ": "
+            << std::chrono::duration_cast<std::chrono::microseconds>(time).count() << "us" << std::endl;
+    }
+}
@@ -0,0 +1,141 @@
+#include "ExternalSort.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+struct SortRecord {
+    std::uint64_t key;
+    std::uint64_t seq;
+};
+
+static bool by_key(const SortRecord& lhs, const SortRecord& rhs) {
+    return lhs.key < rhs.key;
+}
+
+static bool file_exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+class ExternalSortTest: public testing::Test {
+protected:
+    void SetUp() override {
+        input = testing::TempDir() + "external_sort_input.bin";
+        output = testing::TempDir() + "external_sort_output.bin";
+    }
+
+    void TearDown() override {
+        std::remove(input.c_str());
+        std::remove(output.c_str());
+    }
+
+    std::vector<SortRecord> write_input(std::size_t length, std::uint64_t key_range) {
+        std::mt19937_64 engine(234);
+        std::vector<SortRecord> records(length);
+        for(std::size_t i = 0; i < length; i++) {
+            records[i] = SortRecord{engine() % key_range, i};
+        }
+        std::ofstream out(input, std::ios::binary | std::ios::trunc);
+        out.write((const char*)records.data(), records.size() * sizeof(SortRecord));
+        return records;
+    }
+
+    std::vector<SortRecord> read_output() {
+        std::ifstream in(output, std::ios::binary | std::ios::ate);
+        std::size_t bytes = (std::size_t)in.tellg();
+        std::vector<SortRecord> records(bytes / sizeof(SortRecord));
+        in.seekg(0);
+        in.read((char*)records.data(), bytes);
+        return records;
+    }
+
+    void expect_sorted(const std::vector<SortRecord>& input_records) {
+        std::vector<SortRecord> records = read_output();
+        ASSERT_EQ(records.size(), input_records.size());
+        EXPECT_TRUE(std::is_sorted(records.begin(), records.end(), by_key));
+        // same multiset of records
+        std::vector<std::uint64_t> expect_seqs, seqs;
+        for(std::size_t i = 0; i < records.size(); i++) {
+            seqs.push_back(records[i].seq);
+            ASSERT_EQ(records[i].key, input_records[records[i].seq].key);
+        }
+        std::sort(seqs.begin(), seqs.end());
+        for(std::size_t i = 0; i < seqs.size(); i++) {
+            ASSERT_EQ(seqs[i], i);
+        }
+    }
+
+    std::string input;
+    std::string output;
+};
+
+TEST_F(ExternalSortTest, ManyRunsMatchStd) {
+    ThreadPool pool(3);
+    // 160kB of input through 48kB of memory: 10 runs
+    std::vector<SortRecord> records = write_input(10000, 1000000);
+    ASSERT_TRUE(external_sort<SortRecord>(input, output, 48 * 1024, by_key, pool));
+    expect_sorted(records);
+    EXPECT_FALSE(file_exists(output + ".run0"));
+
+    // few distinct keys, splitters land on long stretches of equal keys
+    records = write_input(20011, 3);
+    ASSERT_TRUE(external_sort<SortRecord>(input, output, 16 * 1024, by_key, pool));
+    expect_sorted(records);
+}
+
+TEST_F(ExternalSortTest, SingleRunAndEmptyInput) {
+    std::vector<SortRecord> records = write_input(1000, 100);
+    ASSERT_TRUE(external_sort<SortRecord>(input, output, 1 << 20, by_key));
+    expect_sorted(records);
+
+    records = write_input(0, 1);
+    ASSERT_TRUE(external_sort<SortRecord>(input, output, 1 << 20, by_key));
+    EXPECT_TRUE(read_output().empty());
+}
+
+TEST_F(ExternalSortTest, BadInput) {
+    EXPECT_FALSE(external_sort<SortRecord>(input + ".missing", output, 1 << 20, by_key));
+
+    std::ofstream out(input, std::ios::binary | std::ios::trunc);
+    out.write("odd", 3);
+    out.close();
+    EXPECT_FALSE(external_sort<SortRecord>(input, output, 1 << 20, by_key));
+}
+
+TEST_F(ExternalSortTest, ThroughputBenchmark) {
+    // 32MB through 4MB of memory
+    std::size_t length = (32 << 20) / sizeof(SortRecord);
+    write_input(length, ~0ull);
+    std::size_t bytes = length * sizeof(SortRecord);
+
+    // what the disk does for a plain copy: read and write every byte once
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::ifstream in(input, std::ios::binary);
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        std::vector<char> block(1 << 20);
+        while(in.read(block.data(), block.size()) || in.gcount()) {
+            out.write(block.data(), in.gcount());
+        }
+    }
+    auto copy_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(external_sort<SortRecord>(input, output, 4 << 20, by_key));
+    auto sort_time = std::chrono::steady_clock::now() - start;
+
+    std::vector<SortRecord> records = read_output();
+    EXPECT_TRUE(std::is_sorted(records.begin(), records.end(), by_key));
+
+    double copy_mb_s = bytes / 1e6 / std::chrono::duration<double>(copy_time).count();
+    double sort_mb_s = bytes / 1e6 / std::chrono::duration<double>(sort_time).count();
+    // the sort reads and writes every byte twice
+    std::cout << "external sort of " << (bytes >> 20) << "MB with 4MB of memory: " << sort_mb_s << "MB/s, copy "
+        << copy_mb_s << "MB/s, " << 100.0 * 2 * sort_mb_s / copy_mb_s << "% of copy bandwidth" << std::endl;
+}
@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "FairLocks.h"
+#include "SpinLockMutex.h"
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+template<typename Mutex>
+void many_thread_add() {
+	Mutex mutex;
+	int value = 0;
+	int num_threads = 8, step_count = 5000;
+	std::vector<std::thread> tids;
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&mutex, &value, step_count]() {
+			for (int k = 0; k < step_count; k++) {
+				std::lock_guard<Mutex> lk(mutex);
+				value++;
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	EXPECT_EQ(value, num_threads * step_count);
+}
+
+TEST(TicketLockTest, ManyThreadAdd) {
+	many_thread_add<TicketLock>();
+}
+
+TEST(MCSLockTest, ManyThreadAdd) {
+	many_thread_add<MCSLock>();
+}
+
+TEST(TicketLockTest, TryLock) {
+	TicketLock mutex;
+	ASSERT_TRUE(mutex.try_lock());
+	EXPECT_FALSE(mutex.try_lock());
+	mutex.unlock();
+	EXPECT_TRUE(mutex.try_lock());
+	mutex.unlock();
+}
+
+TEST(MCSLockTest, TryLockAndNesting) {
+	MCSLock first, second;
+	ASSERT_TRUE(first.try_lock());
+	EXPECT_FALSE(first.try_lock());
+	// one thread may hold several MCS locks at once
+	second.lock();
+	first.unlock();
+	EXPECT_TRUE(first.try_lock());
+	second.unlock();
+	first.unlock();
+}
+
+struct FairnessResult {
+	long long total;
+	long long min_count;
+	long long max_count;
+};
+
+// every thread grabs the lock as often as it can for a fixed time
+template<typename Mutex>
+FairnessResult fairness_run(int num_threads, std::chrono::milliseconds duration) {
+	Mutex mutex;
+	std::atomic<bool> start(false), stop(false);
+	std::vector<long long> counts(num_threads, 0);
+	long long shared = 0;
+	std::vector<std::thread> tids;
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&, i]() {
+			while (!start.load()) {
+				std::this_thread::yield();
+			}
+			long long local = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				std::lock_guard<Mutex> lk(mutex);
+				shared++;
+				local++;
+			}
+			counts[i] = local;
+		});
+	}
+	start.store(true);
+	std::this_thread::sleep_for(duration);
+	stop.store(true);
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+
+	FairnessResult result;
+	result.total = shared;
+	result.min_count = *std::min_element(counts.begin(), counts.end());
+	result.max_count = *std::max_element(counts.begin(), counts.end());
+	return result;
+}
+
+template<typename Mutex>
+void print_fairness(const char* name, int num_threads) {
+	FairnessResult result = fairness_run<Mutex>(num_threads, std::chrono::milliseconds(30));
+	std::cout << "  " << name << ": " << result.total << " acquisitions"
+		<< ", per thread min/max: " << result.min_count << "/" << result.max_count << std::endl;
+}
+
+TEST(FairLocksTest, FairnessAndThroughputBenchmark) {
+	int max_threads = std::max(16, 2 * (int)std::thread::hardware_concurrency());
+	for (int num_threads = 2; num_threads <= max_threads; num_threads *= 2) {
+		std::cout << "threads: " << num_threads << std::endl;
+		print_fairness<SpinLockMutex>("SpinLockMutex", num_threads);
+		print_fairness<TicketLock>("TicketLock", num_threads);
+		print_fairness<MCSLock>("MCSLock", num_threads);
+		print_fairness<std::mutex>("std::mutex", num_threads);
+	}
+}
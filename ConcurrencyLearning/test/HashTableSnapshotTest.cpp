@@ -0,0 +1,149 @@
+#include "HashTableSnapshot.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+struct Point {
+	int x;
+	double y;
+};
+
+class HashTableSnapshotTest: public testing::Test {
+protected:
+	void SetUp() override {
+		path = testing::TempDir() + "hash_table_snapshot_test.bin";
+		for (int i = 0; i < num_values; i++) {
+			table.insert_or_update(i, Point{ i, i * 0.5 });
+		}
+	}
+
+	void TearDown() override {
+		std::remove(path.c_str());
+	}
+
+	void expect_all(ThreadSafeHashTable<int, Point>& loaded) {
+		ASSERT_EQ(loaded.size(), num_values);
+		for (int i = 0; i < num_values; i++) {
+			std::optional<Point> opt_value = loaded.get(i);
+			ASSERT_TRUE(opt_value.has_value());
+			ASSERT_EQ(opt_value->x, i);
+			ASSERT_EQ(opt_value->y, i * 0.5);
+		}
+	}
+
+	int num_values = 20000;
+	ThreadSafeHashTable<int, Point> table{ 1031 };
+	std::string path;
+};
+
+TEST_F(HashTableSnapshotTest, SaveAndLoadSameLayout) {
+	ASSERT_TRUE(save_snapshot(table, path));
+
+	ThreadSafeHashTable<int, Point> loaded(1031);
+	ASSERT_TRUE(load_snapshot(loaded, path));
+	expect_all(loaded);
+
+	ThreadPool pool(3);
+	ASSERT_TRUE(save_snapshot(table, path, pool));
+	ThreadSafeHashTable<int, Point> pool_loaded(1031);
+	ASSERT_TRUE(load_snapshot(pool_loaded, path, pool));
+	expect_all(pool_loaded);
+}
+
+TEST_F(HashTableSnapshotTest, LoadIntoDifferentBucketCount) {
+	ASSERT_TRUE(save_snapshot(table, path));
+
+	ThreadSafeHashTable<int, Point> loaded(97);
+	loaded.insert_or_update(0, Point{ -1, -1.0 });
+	ASSERT_TRUE(load_snapshot(loaded, path));
+	expect_all(loaded);
+}
+
+TEST_F(HashTableSnapshotTest, ZeroCopyView) {
+	ASSERT_TRUE(save_snapshot(table, path));
+
+	MappedSnapshot<int, Point> view;
+	ASSERT_TRUE(view.open(path));
+	EXPECT_EQ(view.size(), num_values);
+	for (int i = 0; i < num_values; i++) {
+		std::optional<Point> opt_value = view.get(i);
+		ASSERT_TRUE(opt_value.has_value());
+		ASSERT_EQ(opt_value->x, i);
+	}
+	EXPECT_FALSE(view.get(num_values).has_value());
+
+	long long sum = 0;
+	view.for_each([&sum](const int&, const Point& value) {
+		sum += value.x;
+	});
+	EXPECT_EQ(sum, (long long)num_values * (num_values - 1) / 2);
+}
+
+TEST_F(HashTableSnapshotTest, RejectInvalidFile) {
+	ThreadSafeHashTable<int, Point> loaded;
+	EXPECT_FALSE(load_snapshot(loaded, path + ".missing"));
+
+	ASSERT_TRUE(save_snapshot(table, path));
+	// value type does not match the file
+	ThreadSafeHashTable<int, int> wrong_type;
+	EXPECT_FALSE(load_snapshot(wrong_type, path));
+	MappedSnapshot<int, int> wrong_view;
+	EXPECT_FALSE(wrong_view.open(path));
+	EXPECT_FALSE(wrong_view.get(0).has_value());
+
+	// bucket offsets that run backwards or past the entries
+	for (std::uint64_t offset : { (std::uint64_t)num_values + 1, (std::uint64_t)0 }) {
+		ASSERT_TRUE(save_snapshot(table, path));
+		{
+			std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+			file.seekp(sizeof(SnapshotHeader) + 500 * sizeof(std::uint64_t));
+			file.write((const char*)&offset, sizeof(offset));
+		}
+		ThreadSafeHashTable<int, Point> corrupt(1031);
+		EXPECT_FALSE(load_snapshot(corrupt, path));
+		MappedSnapshot<int, Point> corrupt_view;
+		EXPECT_FALSE(corrupt_view.open(path));
+	}
+}
+
+// same bucket count as the writer, but only the even keys of every bucket
+// stay where std::hash put them
+struct OddShiftHash {
+	std::size_t operator()(int key) const {
+		return key % 2 == 0 ? key : key + 1;
+	}
+};
+
+TEST_F(HashTableSnapshotTest, LoadWithOtherHash) {
+	ASSERT_TRUE(save_snapshot(table, path));
+	ThreadSafeHashTable<int, Point, OddShiftHash> loaded(1031);
+	ASSERT_TRUE(load_snapshot(loaded, path));
+	ASSERT_EQ(loaded.size(), num_values);
+	for (int i = 0; i < num_values; i++) {
+		std::optional<Point> opt_value = loaded.get(i);
+		ASSERT_TRUE(opt_value.has_value());
+		ASSERT_EQ(opt_value->x, i);
+	}
+}
+
+TEST_F(HashTableSnapshotTest, WarmStartBenchmark) {
+	ASSERT_TRUE(save_snapshot(table, path));
+	auto start = std::chrono::steady_clock::now();
+	ThreadSafeHashTable<int, Point> by_insert(1031);
+	for (int i = 0; i < num_values; i++) {
+		by_insert.insert_or_update(i, Point{ i, i * 0.5 });
+	}
+	auto mid = std::chrono::steady_clock::now();
+	ThreadSafeHashTable<int, Point> by_snapshot(1031);
+	ASSERT_TRUE(load_snapshot(by_snapshot, path));
+	auto end = std::chrono::steady_clock::now();
+
+	std::cout << "insert_or_update: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() << "us"
+		<< ", load_snapshot: "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() << "us" << std::endl;
+	expect_all(by_snapshot);
+}
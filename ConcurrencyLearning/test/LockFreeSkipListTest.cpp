@@ -0,0 +1,150 @@
+#include "LockFreeSkipList.h"
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+#include <map>
+#include <random>
+#include <atomic>
+
+TEST(LockFreeSkipListTest, SingleThreadMatchesMap) {
+    LockFreeSkipList<int, int> list;
+    std::map<int, int> expect;
+    std::mt19937 engine(234);
+
+    for(int i = 0; i < 20000; i++) {
+        int key = engine() % 2000;
+        if(engine() % 3 == 0) {
+            EXPECT_EQ(list.erase(key), expect.erase(key) == 1);
+        } else {
+            EXPECT_EQ(list.insert(key, key * 10), expect.insert({ key, key * 10 }).second);
+        }
+    }
+
+    ASSERT_EQ(list.size(), expect.size());
+    for(int key = 0; key < 2000; key++) {
+        std::optional<int> opt_value = list.get(key);
+        ASSERT_EQ(opt_value.has_value(), expect.count(key) == 1);
+        ASSERT_EQ(list.contains(key), expect.count(key) == 1);
+        if(opt_value.has_value()) {
+            ASSERT_EQ(opt_value.value(), key * 10);
+        }
+    }
+
+    std::vector<int> ordered;
+    list.for_each([&ordered](const int& key, const int&) {
+        ordered.push_back(key);
+    });
+    std::vector<int> expect_ordered;
+    for(auto&& kv : expect) {
+        expect_ordered.push_back(kv.first);
+    }
+    EXPECT_EQ(ordered, expect_ordered);
+}
+
+TEST(LockFreeSkipListTest, RangeScan) {
+    LockFreeOrderedSet<int> set;
+    for(int i = 0; i < 100; i += 2) {
+        set.insert(i);
+    }
+
+    std::vector<int> keys;
+    set.range_scan(11, 21, [&keys](const int& key, const std::monostate&) {
+        keys.push_back(key);
+    });
+    EXPECT_EQ(keys, std::vector<int>({ 12, 14, 16, 18, 20 }));
+
+    keys.clear();
+    set.range_scan(200, 300, [&keys](const int& key, const std::monostate&) {
+        keys.push_back(key);
+    });
+    EXPECT_TRUE(keys.empty());
+}
+
+TEST(LockFreeSkipListTest, ConcurrentInsertErase) {
+    LockFreeSkipList<int, int> list;
+    int num_threads = 8, num_keys = 4000;
+
+    // every thread inserts all keys, exactly one insert per key may win
+    std::atomic<int> inserted(0);
+    std::vector<std::thread> tids;
+    for(int t = 0; t < num_threads; t++) {
+        tids.emplace_back([&list, &inserted, t, num_keys]() {
+            for(int i = 0; i < num_keys; i++) {
+                int key = (i * 7 + t) % num_keys;
+                if(list.insert(key, key)) {
+                    inserted++;
+                }
+            }
+        });
+    }
+    for(auto&& tid : tids) {
+        tid.join();
+    }
+    EXPECT_EQ(inserted.load(), num_keys);
+    EXPECT_EQ(list.size(), num_keys);
+
+    // erase odd keys while readers scan, exactly one erase per key may win
+    tids.clear();
+    std::atomic<int> erased(0);
+    std::atomic<bool> done(false);
+    for(int t = 0; t < num_threads / 2; t++) {
+        tids.emplace_back([&list, &erased, num_keys]() {
+            for(int key = 1; key < num_keys; key += 2) {
+                if(list.erase(key)) {
+                    erased++;
+                }
+            }
+        });
+    }
+    std::thread reader([&list, &done, num_keys]() {
+        while(!done.load()) {
+            int prev = -1;
+            list.for_each([&prev](const int& key, const int&) {
+                EXPECT_LT(prev, key);
+                prev = key;
+            });
+            for(int key = 0; key < num_keys; key += 2) {
+                EXPECT_TRUE(list.contains(key));
+            }
+        }
+    });
+    for(auto&& tid : tids) {
+        tid.join();
+    }
+    done.store(true);
+    reader.join();
+
+    EXPECT_EQ(erased.load(), num_keys / 2);
+    EXPECT_EQ(list.size(), num_keys / 2);
+    for(int key = 0; key < num_keys; key++) {
+        ASSERT_EQ(list.contains(key), key % 2 == 0);
+    }
+}
+
+TEST(LockFreeSkipListTest, ChurnReclaimsNodes) {
+    LockFreeSkipList<int, int> list;
+    std::vector<std::thread> tids;
+    for(int t = 0; t < 4; t++) {
+        tids.emplace_back([&list, t]() {
+            for(int round = 0; round < 2000; round++) {
+                int key = round % 64;
+                list.insert(key, t);
+                list.erase(key);
+            }
+            EpochManager::instance().collect();
+        });
+    }
+    for(auto&& tid : tids) {
+        tid.join();
+    }
+
+    // quiescent now, everything retired here can be freed
+    for(int key = 0; key < 64; key++) {
+        list.insert(key, key);
+        list.erase(key);
+    }
+    EpochManager::instance().collect();
+    EXPECT_EQ(EpochManager::instance().pending(), 0);
+    EXPECT_TRUE(list.empty());
+}
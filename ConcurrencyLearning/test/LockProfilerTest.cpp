@@ -0,0 +1,95 @@
+#define LOCK_PROFILING
+
+#include "gtest/gtest.h"
+#include "LockProfiler.h"
+#include "FineGrainedLockQueue.h"
+#include "ThreadSafeHashTable.h"
+#include "ThreadSafeList.h"
+#include "SpinLockMutex.h"
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <iostream>
+
+TEST(LockProfilerTest, CountsPerSite) {
+	LockProfiler::instance().reset();
+	ProfiledMutex<std::mutex> mutex;
+	name_lock_site(mutex, "test.counter");
+
+	int value = 0, num_threads = 4, step_count = 10000;
+	std::vector<std::thread> tids;
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&mutex, &value, step_count]() {
+			for (int k = 0; k < step_count; k++) {
+				std::lock_guard<ProfiledMutex<std::mutex> > lk(mutex);
+				value++;
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+
+	LockSiteStats* stats = LockProfiler::instance().site("test.counter");
+	EXPECT_EQ(value, num_threads * step_count);
+	EXPECT_EQ(stats->acquisitions.load(), num_threads * step_count);
+	EXPECT_EQ(stats->hold_ns.count(), num_threads * step_count);
+	EXPECT_EQ(stats->wait_ns.count(), stats->contended.load());
+	EXPECT_LE(stats->contended.load(), stats->acquisitions.load());
+}
+
+TEST(LockProfilerTest, ContainersNameTheirLocks) {
+	LockProfiler::instance().reset();
+
+	FineGrainedLockQueue<int, ProfiledMutex<std::mutex> > queue;
+	std::thread producer([&queue]() {
+		for (int i = 0; i < 1000; i++) {
+			queue.push(i);
+		}
+	});
+	for (int i = 0; i < 1000; i++) {
+		int value;
+		queue.wait_and_pop(value);
+	}
+	producer.join();
+
+	ThreadSafeHashTable<int, int, std::hash<int>, ProfiledMutex<std::shared_mutex> > hash_table;
+	for (int i = 0; i < 100; i++) {
+		hash_table.insert_or_update(i, i);
+		hash_table.get(i);
+	}
+
+	// exclusive only locks stay exclusive through the wrapper
+	ThreadSafeHashTable<int, int, std::hash<int>, ProfiledMutex<SpinLockMutex> > spin_table;
+	spin_table.insert_or_update(1, 1);
+	spin_table.get(1);
+
+	ThreadSafeList<int, ProfiledMutex<std::mutex> > list;
+	for (int i = 0; i < 10; i++) {
+		list.push_front(i);
+	}
+	list.for_each([](int& data) {
+		data++;
+	});
+
+	LazyThreadSafeList<int, ProfiledMutex<std::mutex> > lazy_list;
+	for (int i = 0; i < 10; i++) {
+		lazy_list.push_front(i);
+	}
+	lazy_list.remove_if([](const int& data) {
+		return data % 2 == 0;
+	});
+
+	LockProfiler& profiler = LockProfiler::instance();
+	EXPECT_GE(profiler.site("FineGrainedLockQueue.head")->acquisitions.load(), 1000);
+	EXPECT_GE(profiler.site("FineGrainedLockQueue.tail")->acquisitions.load(), 1000);
+	EXPECT_EQ(profiler.site("FineGrainedLockQueue.size")->acquisitions.load(), 2000);
+	EXPECT_EQ(profiler.site("ThreadSafeHashTable.stripe")->shared_acquisitions.load(), 100);
+	EXPECT_EQ(profiler.site("ThreadSafeHashTable.stripe")->acquisitions.load(), 100 + 2);
+	EXPECT_EQ(profiler.site("ThreadSafeList.node")->acquisitions.load(), 10 + 11);
+	// the head for every push, pred and curr for every removal
+	EXPECT_EQ(profiler.site("LazyThreadSafeList.node")->acquisitions.load(), 10 + 2 * 5);
+
+	profiler.report(std::cout);
+}
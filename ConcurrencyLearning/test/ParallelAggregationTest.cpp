@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "ParallelAggregation.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Record {
+    int key;
+    int value;
+};
+
+static std::vector<Record> make_records(int length, int num_keys) {
+    srand(234);
+    std::vector<Record> records(length);
+    for(auto&& record : records) {
+        record.key = rand() % num_keys;
+        record.value = rand() % 100;
+    }
+    return records;
+}
+
+TEST(ParallelHistogramTest, MatchesSequential) {
+    std::vector<Record> records = make_records(100000, 40);
+    for(std::size_t grain : {1, 100, 1000000}) {
+        // bins 32 and up are dropped
+        std::vector<std::size_t> counts = parallel_histogram(records.begin(), records.end(), 32, [](const Record& record) {
+            return (std::size_t)record.key;
+        }, SimplePartitioner(grain));
+        std::vector<std::size_t> expect(32, 0);
+        for(auto&& record : records) {
+            if(record.key < 32) {
+                expect[record.key]++;
+            }
+        }
+        EXPECT_EQ(counts, expect);
+    }
+
+    std::vector<Record> empty;
+    EXPECT_EQ(parallel_histogram(empty.begin(), empty.end(), 4, [](const Record&) {
+        return 0;
+    }), std::vector<std::size_t>(4, 0));
+}
+
+TEST(ParallelGroupReduceTest, SumAndMinByKey) {
+    for(int num_keys : {1, 17, 100000}) {
+        std::vector<Record> records = make_records(200000, num_keys);
+        auto key_of = [](const Record& record) {
+            return record.key;
+        };
+        auto value_of = [](const Record& record) {
+            return (long long)record.value;
+        };
+        auto sums = parallel_group_reduce(records.begin(), records.end(), key_of, value_of, std::plus<long long>());
+        auto mins = parallel_group_reduce(records.begin(), records.end(), key_of, value_of, [](long long lhs, long long rhs) {
+            return std::min(lhs, rhs);
+        }, SimplePartitioner(7));
+
+        std::map<int, long long> expect_sums, expect_mins;
+        for(auto&& record : records) {
+            expect_sums[record.key] += record.value;
+            auto it = expect_mins.find(record.key);
+            if(it == expect_mins.end() || record.value < it->second) {
+                expect_mins[record.key] = record.value;
+            }
+        }
+        ASSERT_EQ(sums.size(), expect_sums.size());
+        ASSERT_EQ(mins.size(), expect_mins.size());
+        for(auto&& kv : expect_sums) {
+            EXPECT_EQ(sums.at(kv.first), kv.second);
+            EXPECT_EQ(mins.at(kv.first), expect_mins[kv.first]);
+        }
+    }
+}
+
+TEST(ParallelGroupReduceTest, StringKeys) {
+    std::vector<std::string> words;
+    for(int i = 0; i < 10000; i++) {
+        words.push_back("w" + std::to_string(i % 123));
+    }
+    auto counts = parallel_group_reduce(words.begin(), words.end(), [](const std::string& word) {
+        return word;
+    }, [](const std::string&) {
+        return 1;
+    }, std::plus<int>());
+    EXPECT_EQ(counts.size(), 123u);
+    EXPECT_EQ(counts["w0"], 82);
+    EXPECT_EQ(counts["w122"], 81);
+}
+
+TEST(ParallelGroupReduceTest, Benchmark) {
+    for(int num_keys : {100, 100000}) {
+        std::vector<Record> records = make_records(1000000, num_keys);
+
+        auto start = std::chrono::steady_clock::now();
+        std::unordered_map<int, long long> expect;
+        for(auto&& record : records) {
+            expect[record.key] += record.value;
+        }
+        auto sequential_time = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        auto sums = parallel_group_reduce(records.begin(), records.end(), [](const Record& record) {
+            return record.key;
+        }, [](const Record& record) {
+            return (long long)record.value;
+        }, std::plus<long long>());
+        auto parallel_time = std::chrono::steady_clock::now() - start;
+
+        EXPECT_EQ(sums.size(), expect.size());
+        std::cout << "group by over " << records.size() << " records, " << expect.size() << " keys: sequential "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(sequential_time).count() << "ms, parallel "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(parallel_time).count() << "ms" << std::endl;
+    }
+}
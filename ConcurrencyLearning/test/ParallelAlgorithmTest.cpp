@@ -1,12 +1,17 @@
 #define _SILENCE_CXX17_ADAPTOR_TYPEDEFS_DEPRECATION_WARNING
 
 #include "ParallelAlgorithm.h"
+#include "ExecutionPolicy.h"
 #include "gtest/gtest.h"
 
 #include <iostream>
 #include <vector>
-
-const int PARALLEL = 1, ASYNC = 2, STD = 0, SINGLE = 3, THREAD_POOL = 4;
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <climits>
+#include <cmath>
+#include <functional>
 
 struct TestElem {
     TestElem(int val=0):
@@ -64,18 +69,15 @@ protected:
         values = std::vector<TestElem>(100);
     }
 
-    void for_each_test(int state) {
-        auto handler = [this](const TestElem& value) {
+    void for_each_test(const ExecutionPolicy& policy) {
+        std::atomic<int> handled(0);
+        auto handler = [&handled](const TestElem& value) {
             value.handle();
+            handled++;
         };
-
-        if(state == ASYNC) {
-            async_for_each(values.begin(), values.end(), handler);
-        } else if(state == PARALLEL) {
-            parallel_for_each(values.begin(), values.end(), handler);
-        } else if(state == STD) {
-            std::for_each(values.begin(), values.end(), handler);
-        }
+        // 100 elements are below the default threshold
+        parallel_for_each(policy.with_sequential_threshold(0), values.begin(), values.end(), handler);
+        EXPECT_EQ(handled.load(), (int)values.size());
     }
 
     std::vector<TestElem> values;
@@ -84,15 +86,19 @@ protected:
 
 
 TEST_F(ParallelForEachTest, Async) {
-    for_each_test(ASYNC);
+    for_each_test(ExecutionPolicy::async());
 }
 
 TEST_F(ParallelForEachTest, Std) {
-    for_each_test(STD);
+    for_each_test(ExecutionPolicy::sequential());
 }
 
 TEST_F(ParallelForEachTest, Parallel) {
-    for_each_test(PARALLEL);
+    for_each_test(ExecutionPolicy::pool());
+}
+
+TEST_F(ParallelForEachTest, Threads) {
+    for_each_test(ExecutionPolicy::threads());
 }
 
 ///////////////////////////////////////
@@ -117,20 +123,8 @@ protected:
         *find_it = find_value;
     }
 
-    void find_test(int state) {
-        decltype(values)::iterator it;
-        if(state == PARALLEL) {
-            it = parallel_find(values.begin(), values.end(), find_value);
-        } else if(state == STD) {
-            it = std::find(values.begin(), values.end(), find_value);
-        } else if(state == SINGLE) {
-            for(it = values.begin(); it != values.end(); ++it) {
-                if(*it == find_value) {
-                    break;
-                }
-            }
-        }
-
+    void find_test(const ExecutionPolicy& policy) {
+        auto it = parallel_find_first(policy.with_sequential_threshold(0), values.begin(), values.end(), find_value);
         EXPECT_EQ(it, find_it);
         EXPECT_EQ(*it, find_value);
     }
@@ -141,15 +135,95 @@ protected:
 };
 
 TEST_F(ParallelFindTest, Parallel) {
-    find_test(PARALLEL);
+    find_test(ExecutionPolicy::pool());
 }
 
 TEST_F(ParallelFindTest, Std) {
-    find_test(STD);
+    find_test(ExecutionPolicy::sequential());
 }
 
 TEST_F(ParallelFindTest, Single) {
-    find_test(SINGLE);
+    find_test(ExecutionPolicy::vectorized());
+}
+
+TEST_F(ParallelFindTest, Threads) {
+    find_test(ExecutionPolicy::threads());
+}
+
+///////////////////////////////////////
+// find_if, find_first, any/all/none
+///////////////////////////////////////
+
+TEST(ParallelFindIfTest, FirstMatchIsDeterministic) {
+    std::vector<int> values(20000, 0);
+    for(int pos : {9000, 12345, 19999, 3001, 3000}) {
+        values[pos] = 1;
+    }
+    for(std::size_t grain : {1, 7, 500, 100000}) {
+        for(int run = 0; run < 20; run++) {
+            EXPECT_EQ(parallel_find_if(values.begin(), values.end(), [](int v) {
+                return v == 1;
+            }, SimplePartitioner(grain)), values.begin() + 3000);
+            EXPECT_EQ(parallel_find_first(values.begin(), values.end(), 1, SimplePartitioner(grain)),
+                values.begin() + 3000);
+        }
+    }
+    EXPECT_EQ(parallel_find_if(values.begin(), values.end(), [](int v) {
+        return v == 2;
+    }), values.end());
+
+    // no simd kernel for this element type
+    std::vector<TestElem> elems(100);
+    elems[40] = TestElem(5);
+    elems[70] = TestElem(5);
+    EXPECT_EQ(parallel_find_first(elems.begin(), elems.end(), TestElem(5)), elems.begin() + 40);
+}
+
+TEST(ParallelFindIfTest, AnyAllNone) {
+    std::vector<int> values(10000);
+    std::iota(values.begin(), values.end(), 0);
+    auto negative = [](int v) {
+        return v < 0;
+    };
+    auto big = [](int v) {
+        return v > 9990;
+    };
+    EXPECT_FALSE(parallel_any_of(values.begin(), values.end(), negative));
+    EXPECT_TRUE(parallel_none_of(values.begin(), values.end(), negative));
+    EXPECT_TRUE(parallel_any_of(values.begin(), values.end(), big));
+    EXPECT_FALSE(parallel_all_of(values.begin(), values.end(), big));
+    EXPECT_TRUE(parallel_all_of(values.begin(), values.end(), [](int v) {
+        return v >= 0;
+    }));
+
+    std::vector<int> empty;
+    EXPECT_FALSE(parallel_any_of(empty.begin(), empty.end(), negative));
+    EXPECT_TRUE(parallel_all_of(empty.begin(), empty.end(), negative));
+}
+
+TEST(ParallelFindIfTest, EarlyMatchReturnsQuickly) {
+    std::vector<int> values(10000000, 0);
+    values[1000] = 1;
+    values[5000000] = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    auto it = parallel_find_if(values.begin(), values.end(), [](int v) {
+        return v == 1;
+    });
+    auto early_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    bool none = parallel_none_of(values.begin(), values.end(), [](int v) {
+        return v == 2;
+    });
+    auto full_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(it, values.begin() + 1000);
+    EXPECT_TRUE(none);
+    EXPECT_LT(early_time, full_time);
+    std::cout << "find_if over " << values.size() << " ints: match at 1000 "
+        << std::chrono::duration_cast<std::chrono::microseconds>(early_time).count() << "us, no match "
+        << std::chrono::duration_cast<std::chrono::microseconds>(full_time).count() << "us" << std::endl;
 }
 
 ///////////////////////////////////////
@@ -163,13 +237,8 @@ protected:
         sum.value = 100;
     }
 
-    void accumulate_test(int state) {
-        TestElem result(0);
-        if(state == PARALLEL) {
-            result = parallel_accumulate(values.begin(), values.end(), result);
-        } else if(state == STD) {
-            result = std::accumulate(values.begin(), values.end(), result);
-        }
+    void accumulate_test(const ExecutionPolicy& policy) {
+        TestElem result = parallel_accumulate(policy.with_sequential_threshold(0), values.begin(), values.end(), TestElem(0));
 
         EXPECT_EQ(result, sum);
     }
@@ -179,11 +248,667 @@ protected:
 };
 
 TEST_F(ParallelAccumulateTest, Parallel) {
-    accumulate_test(PARALLEL);
+    accumulate_test(ExecutionPolicy::pool());
 }
 
 TEST_F(ParallelAccumulateTest, Std) {
-    accumulate_test(STD);
+    accumulate_test(ExecutionPolicy::sequential());
+}
+
+TEST_F(ParallelAccumulateTest, Async) {
+    accumulate_test(ExecutionPolicy::async());
+}
+
+///////////////////////////////////////
+// reduce
+///////////////////////////////////////
+
+TEST(ParallelReduceTest, CustomOperators) {
+    std::vector<int> values(10000);
+    srand(234);
+    for(auto&& v : values) {
+        v = rand() % 20001 - 10000;
+    }
+
+    for(ReduceMode mode : {ReduceMode::UNORDERED, ReduceMode::DETERMINISTIC}) {
+        int min_value = parallel_reduce(values.begin(), values.end(), INT_MAX, [](int lhs, int rhs) {
+            return std::min(lhs, rhs);
+        }, mode);
+        int max_value = parallel_reduce(values.begin(), values.end(), INT_MIN, [](int lhs, int rhs) {
+            return std::max(lhs, rhs);
+        }, mode, SimplePartitioner(3));
+        long long sum_of_squares = parallel_transform_reduce(values.begin(), values.end(), 0ll,
+            std::plus<long long>(), [](int v) {
+                return (long long)v * v;
+            }, mode);
+
+        EXPECT_EQ(min_value, *std::min_element(values.begin(), values.end()));
+        EXPECT_EQ(max_value, *std::max_element(values.begin(), values.end()));
+        EXPECT_EQ(sum_of_squares, std::transform_reduce(values.begin(), values.end(), 0ll,
+            std::plus<long long>(), [](int v) {
+                return (long long)v * v;
+            }));
+    }
+
+    std::vector<int> empty;
+    EXPECT_EQ(parallel_reduce(empty.begin(), empty.end(), 7, std::plus<int>()), 7);
+}
+
+TEST(ParallelReduceTest, DeterministicKeepsOrder) {
+    // concatenation is associative but not commutative
+    std::vector<std::string> words(500);
+    std::string expect = ">";
+    for(int i = 0; i < (int)words.size(); i++) {
+        words[i] = std::to_string(i) + ",";
+        expect += words[i];
+    }
+    std::string result = parallel_reduce(words.begin(), words.end(), std::string(">"),
+        std::plus<std::string>(), ReduceMode::DETERMINISTIC, SimplePartitioner(7));
+    EXPECT_EQ(result, expect);
+}
+
+TEST(ParallelReduceTest, DeterministicFloatSumIsReproducible) {
+    std::vector<double> values(100000);
+    srand(234);
+    for(auto&& v : values) {
+        v = (double)rand() / RAND_MAX * std::pow(10.0, rand() % 16 - 8);
+    }
+
+    ThreadPool one_worker(1);
+    ThreadPool three_workers(3);
+    double expect = parallel_reduce(values.begin(), values.end(), 0.0, std::plus<double>(),
+        ReduceMode::DETERMINISTIC, AutoPartitioner(), one_worker);
+    for(int i = 0; i < 10; i++) {
+        double result = parallel_reduce(values.begin(), values.end(), 0.0, std::plus<double>(),
+            ReduceMode::DETERMINISTIC, AutoPartitioner(), i % 2 ? one_worker : three_workers);
+        EXPECT_EQ(result, expect);
+    }
+    EXPECT_NEAR(expect, std::accumulate(values.begin(), values.end(), 0.0), 1e-6 * std::abs(expect));
+}
+
+///////////////////////////////////////
+// scan
+///////////////////////////////////////
+
+TEST(ParallelScanTest, MatchesStd) {
+    for(int length : {0, 1, 5, 100, 1000, 4097}) {
+        std::vector<int> values(length);
+        srand(234);
+        for(auto&& v : values) {
+            v = rand() % 100;
+        }
+        for(std::size_t grain : {1, 3, 64, 5000}) {
+            std::vector<int> expect(length), result(length, -1);
+            std::inclusive_scan(values.begin(), values.end(), expect.begin());
+            auto end = parallel_inclusive_scan(values.begin(), values.end(), result.begin(),
+                std::plus<>(), SimplePartitioner(grain));
+            EXPECT_EQ(end, result.end());
+            EXPECT_EQ(result, expect);
+
+            std::exclusive_scan(values.begin(), values.end(), expect.begin(), 10);
+            parallel_exclusive_scan(values.begin(), values.end(), result.begin(), 10,
+                std::plus<>(), SimplePartitioner(grain));
+            EXPECT_EQ(result, expect);
+        }
+    }
+}
+
+TEST(ParallelScanTest, InPlaceAndCustomOperator) {
+    std::vector<int> values(1000);
+    srand(234);
+    for(auto&& v : values) {
+        v = rand() % 10000;
+    }
+    auto max_op = [](int lhs, int rhs) {
+        return std::max(lhs, rhs);
+    };
+    std::vector<int> expect(values.size());
+    std::inclusive_scan(values.begin(), values.end(), expect.begin(), max_op);
+    std::vector<int> in_place = values;
+    parallel_inclusive_scan(in_place.begin(), in_place.end(), in_place.begin(), max_op, SimplePartitioner(16));
+    EXPECT_EQ(in_place, expect);
+
+    // offsets of variable sized records, the usual use of exclusive scan
+    std::exclusive_scan(values.begin(), values.end(), expect.begin(), 0);
+    in_place = values;
+    parallel_exclusive_scan(in_place.begin(), in_place.end(), in_place.begin(), 0);
+    EXPECT_EQ(in_place, expect);
+
+    // associative but not commutative
+    std::vector<std::string> words = {"a", "b", "c", "d", "e", "f", "g"};
+    std::vector<std::string> prefixes(words.size());
+    parallel_inclusive_scan(words.begin(), words.end(), prefixes.begin(), std::plus<>(), SimplePartitioner(2));
+    EXPECT_EQ(prefixes.back(), "abcdefg");
+    EXPECT_EQ(prefixes[2], "abc");
+}
+
+TEST(ParallelScanTest, Benchmark) {
+    // 10^8 and up does not fit the test machines, the sizes below show
+    // where the two pass scan starts to pay off
+    for(int length = 10000; length <= 10000000; length *= 10) {
+        std::vector<long long> values(length, 1), result(length);
+
+        auto start = std::chrono::steady_clock::now();
+        std::inclusive_scan(values.begin(), values.end(), result.begin());
+        auto std_time = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        parallel_inclusive_scan(values.begin(), values.end(), result.begin());
+        auto parallel_time = std::chrono::steady_clock::now() - start;
+
+        EXPECT_EQ(result.back(), length);
+        std::cout << "inclusive scan of " << length << " elements: std "
+            << std::chrono::duration_cast<std::chrono::microseconds>(std_time).count() << "us, parallel "
+            << std::chrono::duration_cast<std::chrono::microseconds>(parallel_time).count() << "us" << std::endl;
+    }
+}
+
+///////////////////////////////////////
+// adaptive partitioner
+///////////////////////////////////////
+
+TEST(AdaptivePartitionerTest, CoversRangeAndLearnsCost) {
+    AdaptivePartitioner partitioner;
+    EXPECT_EQ(partitioner.ns_per_element(), 0);
+
+    for(int length : {0, 1, 15, 16, 17, 1000, 100000}) {
+        std::vector<int> hits(length, 0);
+        parallel_for_each(hits.begin(), hits.end(), [](int& hit) {
+            hit++;
+        }, partitioner);
+        EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), length);
+    }
+    double light_cost = partitioner.ns_per_element();
+    EXPECT_GT(light_cost, 0);
+
+    AdaptivePartitioner heavy_partitioner;
+    std::vector<int> values(64, 1);
+    std::atomic<int> sum(0);
+    parallel_for_each(values.begin(), values.end(), [&sum](int v) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        sum += v;
+    }, heavy_partitioner);
+    EXPECT_EQ(sum.load(), 64);
+    EXPECT_GT(heavy_partitioner.ns_per_element(), light_cost);
+    // an expensive element is a chunk of its own, a cheap loop gets big chunks
+    EXPECT_EQ(heavy_partitioner.grain_size(1000000, 4), 1u);
+    EXPECT_GT(partitioner.grain_size(1000000, 4), 100u);
+
+    // copies share the estimate
+    AdaptivePartitioner copy = heavy_partitioner;
+    EXPECT_EQ(copy.ns_per_element(), heavy_partitioner.ns_per_element());
+}
+
+TEST(AdaptivePartitionerTest, OtherAlgorithmsAcceptIt) {
+    static AdaptivePartitioner partitioner;
+    std::vector<int> values(10000);
+    std::iota(values.begin(), values.end(), 0);
+    long long expect = std::accumulate(values.begin(), values.end(), 0ll);
+    for(int run = 0; run < 3; run++) {
+        EXPECT_EQ(parallel_reduce(values.begin(), values.end(), 0ll, std::plus<long long>(),
+            ReduceMode::UNORDERED, partitioner), expect);
+        EXPECT_EQ(parallel_reduce(values.begin(), values.end(), 0ll, std::plus<long long>(),
+            ReduceMode::DETERMINISTIC, partitioner), expect);
+        EXPECT_EQ(parallel_find_if(values.begin(), values.end(), [](int v) {
+            return v == 4321;
+        }, partitioner), values.begin() + 4321);
+        std::vector<int> sorted(values.rbegin(), values.rend());
+        parallel_sort(sorted.begin(), sorted.end(), std::less<>(), partitioner);
+        EXPECT_EQ(sorted, values);
+    }
+}
+
+TEST(AdaptivePartitionerTest, Benchmark) {
+    std::vector<int> light(1000000, 1);
+    std::vector<TestElem> heavy(400);
+    auto light_op = [](int& v) {
+        v = v * 3 + 1;
+    };
+    auto heavy_op = [](const TestElem& elem) {
+        elem.handle();
+    };
+
+    auto time_us = [](auto f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return (long long)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    };
+
+    static AdaptivePartitioner light_partitioner;
+    static AdaptivePartitioner heavy_partitioner;
+    for(int run = 0; run < 2; run++) {
+        std::cout << "run " << run << " light loop: grain 25 "
+            << time_us([&]() { parallel_for_each(light.begin(), light.end(), light_op, SimplePartitioner(25)); })
+            << "us, auto "
+            << time_us([&]() { parallel_for_each(light.begin(), light.end(), light_op); })
+            << "us, adaptive "
+            << time_us([&]() { parallel_for_each(light.begin(), light.end(), light_op, light_partitioner); })
+            << "us; heavy loop: grain 25 "
+            << time_us([&]() { parallel_for_each(heavy.begin(), heavy.end(), heavy_op, SimplePartitioner(25)); })
+            << "us, auto "
+            << time_us([&]() { parallel_for_each(heavy.begin(), heavy.end(), heavy_op); })
+            << "us, adaptive "
+            << time_us([&]() { parallel_for_each(heavy.begin(), heavy.end(), heavy_op, heavy_partitioner); })
+            << "us" << std::endl;
+    }
+}
+
+TEST(AffinityPartitionerTest, CoversRangeAndReplaysOwners) {
+    ThreadPool pool(3);
+    AffinityPartitioner partitioner;
+    for(std::size_t length : {0, 1, 100, 5000, 5000, 5000, 777}) {
+        std::vector<std::atomic<int> > visits(length);
+        parallel_for_range(length, [&visits](std::size_t begin, std::size_t end) {
+            for(; begin < end; begin++) {
+                visits[begin]++;
+            }
+        }, partitioner, pool);
+        for(auto&& v : visits) {
+            ASSERT_EQ(v.load(), 1);
+        }
+        std::size_t grain = resolve_grain_size(partitioner, length, pool);
+        std::size_t num_chunks = (length + grain - 1) / grain;
+        std::vector<int> owners = partitioner.last_owners(num_chunks);
+        ASSERT_EQ(owners.size(), num_chunks);
+        for(int owner : owners) {
+            EXPECT_GE(owner, 0);
+            EXPECT_LE(owner, pool.size());
+        }
+    }
+
+    // chunks the calling thread ran last time are its own next time
+    std::vector<int> values(5000, 1);
+    std::size_t grain = resolve_grain_size(partitioner, values.size(), pool);
+    std::size_t num_chunks = (values.size() + grain - 1) / grain;
+    partitioner.record(std::vector<int>(num_chunks, 0));
+    std::atomic<int> on_caller(0);
+    std::thread::id caller = std::this_thread::get_id();
+    parallel_for_range(values.size(), [&](std::size_t, std::size_t) {
+        // long enough chunks that the workers cannot take them all first
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if(std::this_thread::get_id() == caller) {
+            on_caller++;
+        }
+    }, partitioner, pool);
+    EXPECT_GT(on_caller.load(), 0);
+    EXPECT_EQ(parallel_accumulate(values.begin(), values.end(), 0, partitioner, pool), 5000);
+}
+
+///////////////////////////////////////
+// transform, copy_if, remove_if, partition
+///////////////////////////////////////
+
+TEST(ParallelCompactionTest, Transform) {
+    std::vector<int> values(5000);
+    std::iota(values.begin(), values.end(), 0);
+    std::vector<long long> squares(values.size());
+    auto end = parallel_transform(values.begin(), values.end(), squares.begin(), [](int v) {
+        return (long long)v * v;
+    }, SimplePartitioner(33));
+    EXPECT_EQ(end, squares.end());
+    EXPECT_EQ(squares[4999], 4999ll * 4999);
+
+    std::vector<long long> sums(values.size());
+    parallel_transform(values.begin(), values.end(), squares.begin(), sums.begin(), [](int v, long long square) {
+        return v + square;
+    });
+    EXPECT_EQ(sums[10], 110);
+
+    // in place
+    parallel_transform(values.begin(), values.end(), values.begin(), [](int v) {
+        return -v;
+    });
+    EXPECT_EQ(values[4999], -4999);
+}
+
+TEST(ParallelCompactionTest, CopyRemovePartitionMatchStd) {
+    srand(234);
+    std::vector<int> values(20000);
+    for(auto&& v : values) {
+        v = rand() % 1000;
+    }
+    for(int threshold : {0, 100, 500, 900, 1000}) {
+        auto pred = [threshold](int v) {
+            return v < threshold;
+        };
+        for(std::size_t grain : {1, 13, 4096, 100000}) {
+            std::vector<int> expect, result(values.size(), -1);
+            std::copy_if(values.begin(), values.end(), std::back_inserter(expect), pred);
+            auto end = parallel_copy_if(values.begin(), values.end(), result.begin(), pred, SimplePartitioner(grain));
+            ASSERT_EQ(end - result.begin(), (long)expect.size());
+            EXPECT_TRUE(std::equal(expect.begin(), expect.end(), result.begin()));
+
+            std::vector<int> removed = values;
+            expect = values;
+            expect.erase(std::remove_if(expect.begin(), expect.end(), pred), expect.end());
+            removed.erase(parallel_remove_if(removed.begin(), removed.end(), pred, SimplePartitioner(grain)), removed.end());
+            EXPECT_EQ(removed, expect);
+
+            std::vector<int> partitioned = values;
+            expect = values;
+            auto expect_point = std::stable_partition(expect.begin(), expect.end(), pred);
+            auto point = parallel_partition(partitioned.begin(), partitioned.end(), pred, SimplePartitioner(grain));
+            EXPECT_EQ(point - partitioned.begin(), expect_point - expect.begin());
+            EXPECT_EQ(partitioned, expect);
+        }
+    }
+
+    std::vector<int> empty;
+    EXPECT_EQ(parallel_copy_if(empty.begin(), empty.end(), empty.begin(), [](int) { return true; }), empty.begin());
+    EXPECT_EQ(parallel_remove_if(empty.begin(), empty.end(), [](int) { return true; }), empty.end());
+}
+
+TEST(ParallelCompactionTest, PredicateCalledOnce) {
+    std::vector<std::string> words(1000);
+    for(int i = 0; i < (int)words.size(); i++) {
+        words[i] = std::to_string(i);
+    }
+    std::atomic<int> calls(0);
+    auto end = parallel_remove_if(words.begin(), words.end(), [&calls](const std::string& word) {
+        calls++;
+        return word.back() == '7';
+    });
+    EXPECT_EQ(calls.load(), 1000);
+    EXPECT_EQ(end - words.begin(), 900);
+    EXPECT_EQ(words[7], "8");
+}
+
+TEST(ParallelCompactionTest, CopyIfBenchmark) {
+    srand(234);
+    std::vector<int> values(10000000);
+    for(auto&& v : values) {
+        v = rand() % 100;
+    }
+    std::vector<int> result(values.size());
+    for(int selectivity : {10, 50, 90}) {
+        auto pred = [selectivity](int v) {
+            return v < selectivity;
+        };
+        auto start = std::chrono::steady_clock::now();
+        auto std_end = std::copy_if(values.begin(), values.end(), result.begin(), pred);
+        auto std_time = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        auto parallel_end = parallel_copy_if(values.begin(), values.end(), result.begin(), pred);
+        auto parallel_time = std::chrono::steady_clock::now() - start;
+
+        EXPECT_EQ(std_end, parallel_end);
+        std::cout << "copy_if of " << values.size() << " ints keeping " << selectivity << "%: std "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std_time).count() << "ms, parallel "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(parallel_time).count() << "ms" << std::endl;
+    }
+}
+
+///////////////////////////////////////
+// merge sort
+///////////////////////////////////////
+
+TEST(ParallelSortTest, MatchesStdOnSkewedData) {
+    srand(234);
+    std::vector<std::vector<int> > inputs;
+    for(int length : {0, 1, 2, 17, 1000, 10007}) {
+        std::vector<int> values(length);
+        for(auto&& v : values) {
+            v = rand();
+        }
+        inputs.push_back(values);
+        // few distinct keys, sorted and reversed runs
+        for(auto&& v : values) {
+            v %= 3;
+        }
+        inputs.push_back(values);
+        std::sort(values.begin(), values.end());
+        inputs.push_back(values);
+        std::reverse(values.begin(), values.end());
+        inputs.push_back(values);
+    }
+
+    for(auto&& input : inputs) {
+        std::vector<int> expect = input;
+        std::sort(expect.begin(), expect.end());
+        for(std::size_t grain : {1, 5, 100, 100000}) {
+            std::vector<int> values = input;
+            parallel_sort(values.begin(), values.end(), std::less<>(), SimplePartitioner(grain));
+            EXPECT_EQ(values, expect);
+        }
+        std::vector<int> values = input;
+        parallel_sort(values.begin(), values.end(), std::greater<>());
+        EXPECT_TRUE(std::is_sorted(values.begin(), values.end(), std::greater<>()));
+    }
+}
+
+TEST(ParallelSortTest, StableAndByKey) {
+    struct Record {
+        int key;
+        int seq;
+    };
+    srand(234);
+    std::vector<Record> records(5000);
+    for(int i = 0; i < (int)records.size(); i++) {
+        records[i] = Record{rand() % 50, i};
+    }
+
+    for(std::size_t grain : {1, 7, 256}) {
+        std::vector<Record> sorted = records;
+        parallel_stable_sort_by_key(sorted.begin(), sorted.end(), [](const Record& record) {
+            return record.key;
+        }, SimplePartitioner(grain));
+        for(int i = 1; i < (int)sorted.size(); i++) {
+            ASSERT_TRUE(sorted[i - 1].key < sorted[i].key ||
+                (sorted[i - 1].key == sorted[i].key && sorted[i - 1].seq < sorted[i].seq));
+        }
+    }
+
+    std::vector<Record> sorted = records;
+    parallel_sort_by_key(sorted.begin(), sorted.end(), [](const Record& record) {
+        return -record.key;
+    });
+    for(int i = 1; i < (int)sorted.size(); i++) {
+        ASSERT_GE(sorted[i - 1].key, sorted[i].key);
+    }
+}
+
+TEST(ParallelSortTest, Benchmark) {
+    srand(234);
+    std::vector<int> input(1000000);
+    for(auto&& v : input) {
+        v = rand();
+    }
+
+    std::vector<int> values = input;
+    auto start = std::chrono::steady_clock::now();
+    std::sort(values.begin(), values.end());
+    auto std_time = std::chrono::steady_clock::now() - start;
+
+    std::vector<int> parallel_values = input;
+    start = std::chrono::steady_clock::now();
+    parallel_sort(parallel_values.begin(), parallel_values.end());
+    auto parallel_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(parallel_values, values);
+    std::cout << "sort of " << input.size() << " ints: std "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(std_time).count() << "ms, parallel merge sort "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(parallel_time).count() << "ms" << std::endl;
+}
+
+///////////////////////////////////////
+// selection
+///////////////////////////////////////
+
+TEST(ParallelSelectionTest, MatchesStd) {
+    srand(234);
+    std::vector<std::vector<int> > inputs;
+    for(int length : {0, 1, 100, 20000, 100003}) {
+        std::vector<int> values(length);
+        for(auto&& v : values) {
+            v = rand();
+        }
+        inputs.push_back(values);
+        for(auto&& v : values) {
+            v %= 3;
+        }
+        inputs.push_back(values);
+        std::sort(values.begin(), values.end());
+        inputs.push_back(std::vector<int>(values.rbegin(), values.rend()));
+    }
+
+    for(auto&& input : inputs) {
+        std::vector<int> sorted = input;
+        std::sort(sorted.begin(), sorted.end());
+        std::size_t length = input.size();
+        for(std::size_t nth : {std::size_t(0), length / 3, length ? length - 1 : 0}) {
+            if(nth >= length) {
+                continue;
+            }
+            std::vector<int> values = input;
+            parallel_nth_element(values.begin(), values.begin() + nth, values.end(), std::less<>(), SimplePartitioner(1000));
+            ASSERT_EQ(values[nth], sorted[nth]);
+            EXPECT_TRUE(std::all_of(values.begin(), values.begin() + nth, [&](int v) { return v <= values[nth]; }));
+            EXPECT_TRUE(std::all_of(values.begin() + nth, values.end(), [&](int v) { return v >= values[nth]; }));
+        }
+
+        std::size_t k = std::min<std::size_t>(length, 100);
+        std::vector<int> values = input;
+        parallel_partial_sort(values.begin(), values.begin() + k, values.end());
+        EXPECT_TRUE(std::equal(sorted.begin(), sorted.begin() + k, values.begin()));
+        std::sort(values.begin(), values.end());
+        EXPECT_EQ(values, sorted);
+
+        EXPECT_EQ(parallel_top_k(input.begin(), input.end(), k), std::vector<int>(sorted.begin(), sorted.begin() + k));
+        EXPECT_EQ(parallel_top_k(input.begin(), input.end(), k, std::greater<>(), SimplePartitioner(7)),
+            std::vector<int>(sorted.rbegin(), sorted.rbegin() + k));
+        EXPECT_EQ(parallel_top_k(input.begin(), input.end(), length + 5), sorted);
+    }
+}
+
+TEST(ParallelSelectionTest, Benchmark) {
+    srand(234);
+    std::vector<int> input(10000000);
+    for(auto&& v : input) {
+        v = rand();
+    }
+
+    std::vector<int> values = input;
+    auto start = std::chrono::steady_clock::now();
+    std::partial_sort(values.begin(), values.begin() + 100, values.end(), std::greater<>());
+    auto std_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<int> top = parallel_top_k(input.begin(), input.end(), 100, std::greater<>());
+    auto top_k_time = std::chrono::steady_clock::now() - start;
+
+    std::vector<int> nth_values = input;
+    start = std::chrono::steady_clock::now();
+    parallel_nth_element(nth_values.begin(), nth_values.begin() + nth_values.size() / 2, nth_values.end());
+    auto nth_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_TRUE(std::equal(top.begin(), top.end(), values.begin()));
+    std::cout << "top 100 of " << input.size() << " ints: std partial_sort "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(std_time).count() << "ms, parallel top_k "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(top_k_time).count() << "ms, parallel median "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(nth_time).count() << "ms" << std::endl;
+}
+
+///////////////////////////////////////
+// grain size and pool
+///////////////////////////////////////
+
+TEST(ParallelGrainSizeTest, AnyGrainCoversRange) {
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    long long expect_sum = std::accumulate(values.begin(), values.end(), 0ll);
+
+    for(std::size_t grain : {1, 7, 64, 999, 1000, 5000}) {
+        std::atomic<long long> sum(0);
+        parallel_for_each(values.begin(), values.end(), [&sum](int v) {
+            sum.fetch_add(v);
+        }, SimplePartitioner(grain));
+        EXPECT_EQ(sum.load(), expect_sum);
+
+        std::atomic<long long> async_sum(0);
+        async_for_each(values.begin(), values.end(), [&async_sum](int v) {
+            async_sum.fetch_add(v);
+        }, SimplePartitioner(grain));
+        EXPECT_EQ(async_sum.load(), expect_sum);
+
+        EXPECT_EQ(parallel_accumulate(values.begin(), values.end(), 0ll, SimplePartitioner(grain)), expect_sum);
+        EXPECT_EQ(parallel_find(values.begin(), values.end(), 777, SimplePartitioner(grain)), values.begin() + 777);
+        EXPECT_EQ(parallel_find(values.begin(), values.end(), -1, SimplePartitioner(grain)), values.end());
+    }
+}
+
+TEST(ParallelGrainSizeTest, OwnPoolAndUnevenWork) {
+    ThreadPool pool(3);
+    std::vector<int> values(200, 0);
+    parallel_for_each(values.begin(), values.end(), [](int& v) {
+        v = 1;
+    }, SimplePartitioner(4), pool);
+    EXPECT_EQ(std::count(values.begin(), values.end(), 1), 200);
+
+    // the first elements are far more expensive than the rest
+    std::vector<int> costs(64, 0);
+    for(int i = 0; i < 8; i++) {
+        costs[i] = 2000;
+    }
+    std::atomic<int> visited(0);
+    parallel_for_each(costs.begin(), costs.end(), [&visited](int cost) {
+        std::this_thread::sleep_for(std::chrono::microseconds(cost));
+        visited++;
+    }, SimplePartitioner(1), pool);
+    EXPECT_EQ(visited.load(), 64);
+}
+
+TEST(ParallelGrainSizeTest, ExceptionPropagates) {
+    std::vector<int> values(1000, 0);
+    values[500] = 1;
+    EXPECT_THROW(parallel_for_each(values.begin(), values.end(), [](int v) {
+        if(v) {
+            throw std::runtime_error("bad element");
+        }
+    }, SimplePartitioner(10)), std::runtime_error);
+
+    // the pool is still usable afterwards
+    EXPECT_EQ(parallel_accumulate(values.begin(), values.end(), 0), 1);
+}
+
+TEST(ParallelGrainSizeTest, RepeatedCallsBenchmark) {
+    std::vector<int> values(10000, 1);
+    int num_calls = 200;
+
+    auto start = std::chrono::steady_clock::now();
+    long long pool_sum = 0;
+    for(int i = 0; i < num_calls; i++) {
+        pool_sum += parallel_accumulate(values.begin(), values.end(), 0ll);
+    }
+    auto pool_time = std::chrono::steady_clock::now() - start;
+
+    // what every call paid before: one new thread per block
+    start = std::chrono::steady_clock::now();
+    long long thread_sum = 0;
+    int num_threads = std::max(2u, std::thread::hardware_concurrency());
+    for(int i = 0; i < num_calls; i++) {
+        std::vector<long long> results(num_threads);
+        std::vector<std::thread> threads;
+        {
+            JoinThreads joiner(threads);
+            int block_size = (int)values.size() / num_threads;
+            for(int t = 0; t < num_threads; t++) {
+                auto block_start = values.begin() + t * block_size;
+                auto block_end = t == num_threads - 1 ? values.end() : block_start + block_size;
+                threads.emplace_back([block_start, block_end, &results, t]() {
+                    results[t] = std::accumulate(block_start, block_end, 0ll);
+                });
+            }
+        }
+        thread_sum += std::accumulate(results.begin(), results.end(), 0ll);
+    }
+    auto thread_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(pool_sum, thread_sum);
+    std::cout << num_calls << " accumulate calls over " << values.size() << " ints: pool "
+        << std::chrono::duration_cast<std::chrono::microseconds>(pool_time).count() << "us, thread per call "
+        << std::chrono::duration_cast<std::chrono::microseconds>(thread_time).count() << "us" << std::endl;
 }
 
 ///////////////////////////////////////
@@ -210,26 +935,21 @@ protected:
         });
     }
 
-    void quick_sort_test(int state) {
-        if(state == ASYNC) {
-            async_quick_sort(values.begin(), values.end());
-        } else if(state == STD) {
-            std::sort(values.begin(), values.end());
-        } else if(state == THREAD_POOL) {
-            thread_pool_quick_sort(values.begin(), values.end());
-        }
+    // async runs async_quick_sort, threads thread_pool_quick_sort
+    void quick_sort_test(const ExecutionPolicy& policy) {
+        parallel_sort(policy.with_sequential_threshold(0), values.begin(), values.end());
     }
 
     void expect_equal() {
         values = unsorted_values;
-        quick_sort_test(ASYNC);
+        quick_sort_test(ExecutionPolicy::async());
 
         for(int i = 0; i < (int)values.size(); i++) {
             ASSERT_EQ(values[i].value, sorted_values[i].value);
         }
 
         values = unsorted_values;
-        quick_sort_test(THREAD_POOL);
+        quick_sort_test(ExecutionPolicy::threads());
 
         for(int i = 0; i < (int)values.size(); i++) {
             ASSERT_EQ(values[i].value, sorted_values[i].value);
@@ -246,17 +966,17 @@ protected:
 };
 
 TEST_F(ParallelQuickSortTest, Std) {
-    quick_sort_test(STD);
+    quick_sort_test(ExecutionPolicy::sequential());
 }
 
 
 
 TEST_F(ParallelQuickSortTest, ThreadPool) {
-    quick_sort_test(THREAD_POOL);
+    quick_sort_test(ExecutionPolicy::threads());
 }
 
 TEST_F(ParallelQuickSortTest, Async) {
-    quick_sort_test(ASYNC);
+    quick_sort_test(ExecutionPolicy::async());
 }
 
 TEST_F(ParallelQuickSortTest, Equal) {
@@ -0,0 +1,209 @@
+#include "Pipeline.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// source of 0 .. count - 1
+static auto counter(int count) {
+    return [i = 0, count]() mutable -> std::optional<int> {
+        if(i == count) {
+            return std::nullopt;
+        }
+        return i++;
+    };
+}
+
+static void jitter(int value) {
+    if(value % 7 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(value % 50));
+    }
+}
+
+TEST(PipelineTest, InOrderStageKeepsSourceOrder) {
+    ThreadPool pool(3);
+    for(std::size_t batch_size : {1, 3, 64}) {
+        for(std::size_t tokens : {1, 2, 8}) {
+            std::vector<std::string> seen;
+            make_pipeline(counter(1000))
+                .then(StageMode::PARALLEL, [](int value) {
+                    jitter(value);
+                    return value * 2;
+                })
+                .then(StageMode::PARALLEL, [](int value) {
+                    return std::to_string(value);
+                })
+                .then(StageMode::SERIAL_IN_ORDER, [&seen](std::string value) {
+                    seen.push_back(std::move(value));
+                })
+                .run(tokens, batch_size, pool);
+
+            ASSERT_EQ(seen.size(), 1000u);
+            for(int i = 0; i < 1000; i++) {
+                ASSERT_EQ(seen[i], std::to_string(i * 2));
+            }
+        }
+    }
+}
+
+TEST(PipelineTest, SerialStagesRunOneBatchAtATime) {
+    ThreadPool pool(4);
+    std::atomic<int> inside(0);
+    std::atomic<int> overlaps(0);
+    long long sum = 0;
+    int count = 0;
+    make_pipeline(counter(2000))
+        .then(StageMode::PARALLEL, [](int value) {
+            jitter(value);
+            return (long long)value;
+        })
+        .then(StageMode::SERIAL_OUT_OF_ORDER, [&](long long value) {
+            if(inside.fetch_add(1) != 0) {
+                overlaps++;
+            }
+            // not atomic, a second thread in here would lose updates
+            sum += value;
+            count++;
+            inside.fetch_sub(1);
+            return value;
+        })
+        .then(StageMode::PARALLEL, [](long long) {
+
+        })
+        .run(0, 7, pool);
+
+    EXPECT_EQ(overlaps.load(), 0);
+    EXPECT_EQ(count, 2000);
+    EXPECT_EQ(sum, 1999ll * 2000 / 2);
+}
+
+TEST(PipelineTest, TokensBoundItemsInFlight) {
+    ThreadPool pool(3);
+    std::atomic<int> in_flight(0);
+    std::atomic<int> most(0);
+    int i = 0;
+    std::size_t tokens = 3, batch_size = 4;
+    make_pipeline([&]() -> std::optional<int> {
+            if(i == 500) {
+                return std::nullopt;
+            }
+            int now = ++in_flight;
+            int seen = most.load();
+            while(now > seen && !most.compare_exchange_weak(seen, now));
+            return i++;
+        })
+        .then(StageMode::PARALLEL, [](int value) {
+            jitter(value);
+            return value;
+        })
+        // a slow serial stage, the source has to wait for it
+        .then(StageMode::SERIAL_IN_ORDER, [&](int) {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            in_flight--;
+        })
+        .run(tokens, batch_size, pool);
+
+    EXPECT_EQ(in_flight.load(), 0);
+    EXPECT_LE(most.load(), (int)(tokens * batch_size));
+}
+
+TEST(PipelineTest, MoveOnlyItemsAndEmptySource) {
+    int total = 0;
+    make_pipeline(counter(100))
+        .then(StageMode::PARALLEL, [](int value) {
+            return std::make_unique<int>(value);
+        })
+        .then(StageMode::SERIAL_IN_ORDER, [&total](std::unique_ptr<int> value) {
+            total += *value;
+        })
+        .run(4, 8);
+    EXPECT_EQ(total, 4950);
+
+    int calls = 0;
+    make_pipeline(counter(0))
+        .then(StageMode::SERIAL_IN_ORDER, [&calls](int) {
+            calls++;
+        })
+        .run();
+    EXPECT_EQ(calls, 0);
+}
+
+TEST(PipelineTest, ExceptionStopsTheSource) {
+    ThreadPool pool(2);
+    for(StageMode mode : {StageMode::PARALLEL, StageMode::SERIAL_IN_ORDER, StageMode::SERIAL_OUT_OF_ORDER}) {
+        std::atomic<int> read(0);
+        auto pipeline = make_pipeline([&read]() -> std::optional<int> {
+                return read++;
+            })
+            .then(mode, [](int value) {
+                if(value == 100) {
+                    throw std::runtime_error("bad item");
+                }
+                return value;
+            })
+            .then(StageMode::SERIAL_IN_ORDER, [](int value) {
+                jitter(value);
+            });
+        EXPECT_THROW(pipeline.run(4, 2, pool), std::runtime_error);
+        // the source is endless, only the tokens in flight were read ahead
+        EXPECT_LT(read.load(), 100 + 4 * 2 + 2);
+    }
+
+    int i = 0;
+    EXPECT_THROW(make_pipeline([&i]() -> std::optional<int> {
+            if(i == 50) {
+                throw std::runtime_error("bad read");
+            }
+            return i++;
+        })
+        .then(StageMode::SERIAL_IN_ORDER, [](int) {
+
+        })
+        .run(2, 3, pool), std::runtime_error);
+}
+
+TEST(PipelineTest, Benchmark) {
+    // parse, transform, aggregate
+    int count = 200000;
+    auto parse = [](int value) {
+        return std::to_string(value);
+    };
+    auto transform = [](std::string text) {
+        double value = std::stod(text);
+        return std::sqrt(value) * std::log(value + 1);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    double sequential_sum = 0;
+    for(int i = 0; i < count; i++) {
+        sequential_sum += transform(parse(i));
+    }
+    auto sequential_time = std::chrono::steady_clock::now() - start;
+
+    for(std::size_t batch_size : {1, 256}) {
+        double sum = 0;
+        start = std::chrono::steady_clock::now();
+        make_pipeline(counter(count))
+            .then(StageMode::PARALLEL, parse)
+            .then(StageMode::PARALLEL, transform)
+            .then(StageMode::SERIAL_IN_ORDER, [&sum](double value) {
+                sum += value;
+            })
+            .run(0, batch_size);
+        auto time = std::chrono::steady_clock::now() - start;
+
+        // in order, so the float sum is the same as the loop's
+        EXPECT_EQ(sum, sequential_sum);
+        std::cout << "pipeline of " << count << " items, batches of " << batch_size << ": "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(time).count() << "ms, plain loop "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(sequential_time).count() << "ms" << std::endl;
+    }
+}
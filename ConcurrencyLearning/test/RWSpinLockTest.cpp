@@ -0,0 +1,185 @@
+#include "gtest/gtest.h"
+#include "RWSpinLock.h"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+#include <iostream>
+
+template<typename Mutex>
+void writers_exclusive() {
+	Mutex mutex;
+	int value = 0;
+	int num_threads = 4, step_count = 50000;
+
+	std::vector<std::thread> tids;
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&mutex, &value, step_count]() {
+			for (int k = 0; k < step_count; k++) {
+				std::lock_guard<Mutex> lk(mutex);
+				value += 1;
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	EXPECT_EQ(value, num_threads * step_count);
+}
+
+template<typename Mutex>
+void readers_see_consistent_pair() {
+	Mutex mutex;
+	int first = 0, second = 0;
+	std::atomic<bool> done(false);
+	std::atomic<int> torn_reads(0);
+
+	std::thread writer([&]() {
+		for (int k = 0; k < 20000; k++) {
+			std::lock_guard<Mutex> lk(mutex);
+			first++;
+			second++;
+		}
+		done.store(true);
+	});
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 3; i++) {
+		readers.emplace_back([&]() {
+			while (!done.load()) {
+				std::shared_lock<Mutex> lk(mutex);
+				if (first != second) {
+					torn_reads++;
+				}
+			}
+		});
+	}
+
+	writer.join();
+	for (auto&& tid : readers) {
+		tid.join();
+	}
+	EXPECT_EQ(torn_reads.load(), 0);
+	EXPECT_EQ(first, 20000);
+}
+
+TEST(RWSpinLockTest, WritersExclusive) {
+	writers_exclusive<RWSpinLock>();
+}
+
+TEST(RWSpinLockTest, ReadersSeeConsistentPair) {
+	readers_see_consistent_pair<RWSpinLock>();
+}
+
+TEST(DistributedRWSpinLockTest, WritersExclusive) {
+	writers_exclusive< DistributedRWSpinLock<> >();
+}
+
+TEST(DistributedRWSpinLockTest, ReadersSeeConsistentPair) {
+	readers_see_consistent_pair< DistributedRWSpinLock<4> >();
+}
+
+template<typename Mutex>
+void try_lock_test() {
+	Mutex mutex;
+	ASSERT_TRUE(mutex.try_lock_shared());
+	ASSERT_TRUE(mutex.try_lock_shared());
+	EXPECT_FALSE(mutex.try_lock());
+	mutex.unlock_shared();
+	mutex.unlock_shared();
+
+	ASSERT_TRUE(mutex.try_lock());
+	EXPECT_FALSE(mutex.try_lock_shared());
+	EXPECT_FALSE(mutex.try_lock());
+	mutex.unlock();
+	EXPECT_TRUE(mutex.try_lock_shared());
+	mutex.unlock_shared();
+}
+
+TEST(RWSpinLockTest, TryLock) {
+	try_lock_test<RWSpinLock>();
+}
+
+TEST(DistributedRWSpinLockTest, TryLock) {
+	try_lock_test< DistributedRWSpinLock<> >();
+}
+
+// readers overlap so the lock is never free of them, a writer still gets in
+template<typename Mutex>
+void writer_not_starved() {
+	Mutex mutex;
+	std::atomic<bool> done(false);
+	std::atomic<int> num_reading(0);
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 3; i++) {
+		readers.emplace_back([&mutex, &done, &num_reading]() {
+			bool counted = false;
+			while (!done.load()) {
+				std::shared_lock<Mutex> lk(mutex);
+				if (!counted) {
+					num_reading++;
+					counted = true;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		});
+	}
+	while (num_reading.load() < 3) {
+		std::this_thread::yield();
+	}
+
+	int value = 0;
+	for (int k = 0; k < 100; k++) {
+		std::lock_guard<Mutex> lk(mutex);
+		value++;
+	}
+	done.store(true);
+	for (auto&& tid : readers) {
+		tid.join();
+	}
+	EXPECT_EQ(value, 100);
+}
+
+TEST(RWSpinLockTest, WriterNotStarved) {
+	writer_not_starved<RWSpinLock>();
+}
+
+TEST(DistributedRWSpinLockTest, WriterNotStarved) {
+	writer_not_starved< DistributedRWSpinLock<> >();
+}
+
+// readers only, the shared counter of RWSpinLock bounces between cores,
+// the distributed lock keeps every reader on its own line
+template<typename Mutex>
+long long read_only_us(int num_threads) {
+	Mutex mutex;
+	int num_iterations = 100000;
+	std::vector<std::thread> tids;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&mutex, num_iterations]() {
+			for (int k = 0; k < num_iterations; k++) {
+				mutex.lock_shared();
+				mutex.unlock_shared();
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(DistributedRWSpinLockTest, ReaderScalingBenchmark) {
+	int max_threads = std::max(4, (int)std::thread::hardware_concurrency());
+	for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		std::cout << "readers: " << num_threads
+			<< ", std::shared_mutex: " << read_only_us<std::shared_mutex>(num_threads) << "us"
+			<< ", RWSpinLock: " << read_only_us<RWSpinLock>(num_threads) << "us"
+			<< ", DistributedRWSpinLock: " << read_only_us< DistributedRWSpinLock<> >(num_threads) << "us"
+			<< std::endl;
+	}
+}
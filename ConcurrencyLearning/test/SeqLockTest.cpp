@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+#include "SeqLock.h"
+#include <thread>
+#include <vector>
+#include <atomic>
+
+struct Stats {
+	long long count;
+	long long sum;
+	double mean;
+	int checksum;
+};
+
+TEST(SeqLockTest, LoadStore) {
+	SeqLock<Stats> stats(Stats{ 0, 0, 0.0, 0 });
+	Stats value = stats.load();
+	EXPECT_EQ(value.count, 0);
+
+	stats.store(Stats{ 2, 10, 5.0, 17 });
+	value = stats.load();
+	EXPECT_EQ(value.count, 2);
+	EXPECT_EQ(value.sum, 10);
+	EXPECT_EQ(value.mean, 5.0);
+	EXPECT_EQ(value.checksum, 17);
+}
+
+TEST(SeqLockTest, ReadersNeverSeeTornValues) {
+	SeqLock<Stats> stats(Stats{ 0, 0, 0.0, 0 });
+	std::atomic<bool> done(false);
+	std::atomic<int> torn_reads(0);
+	int num_writers = 2, updates_per_writer = 20000;
+
+	std::vector<std::thread> writers, readers;
+	for (int i = 0; i < num_writers; i++) {
+		writers.emplace_back([&stats, updates_per_writer]() {
+			for (int k = 0; k < updates_per_writer; k++) {
+				stats.update([k](Stats& value) {
+					value.count++;
+					value.sum += k;
+					value.mean = (double)value.sum / value.count;
+					value.checksum = (int)(value.count * 7 + value.sum * 3);
+				});
+			}
+		});
+	}
+	for (int i = 0; i < 3; i++) {
+		readers.emplace_back([&stats, &done, &torn_reads]() {
+			while (!done.load()) {
+				Stats value = stats.load();
+				if (value.checksum != (int)(value.count * 7 + value.sum * 3)) {
+					torn_reads++;
+				}
+			}
+		});
+	}
+
+	for (auto&& tid : writers) {
+		tid.join();
+	}
+	done.store(true);
+	for (auto&& tid : readers) {
+		tid.join();
+	}
+
+	EXPECT_EQ(torn_reads.load(), 0);
+	EXPECT_EQ(stats.load().count, (long long)num_writers * updates_per_writer);
+}
@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+#include "SimdKernels.h"
+#include "ParallelAlgorithm.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+static std::vector<SimdLevel> supported_levels() {
+    std::vector<SimdLevel> levels;
+    for(SimdLevel level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if(level <= simd_level()) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+TEST(SimdKernelsTest, SumEveryLevelAndTail) {
+    for(SimdLevel level : supported_levels()) {
+        for(int n : {0, 1, 3, 15, 16, 17, 63, 64, 65, 1000}) {
+            std::vector<std::int32_t> ints(n);
+            std::vector<double> doubles(n);
+            std::vector<float> floats(n);
+            for(int i = 0; i < n; i++) {
+                ints[i] = i * 7 - 300;
+                doubles[i] = i * 0.5;
+                floats[i] = (float)(i % 8);
+            }
+            EXPECT_EQ(simd_sum(ints.data(), n, level), std::accumulate(ints.begin(), ints.end(), 0));
+            // exactly representable sums, lane order does not matter
+            EXPECT_EQ(simd_sum(doubles.data(), n, level), std::accumulate(doubles.begin(), doubles.end(), 0.0));
+            EXPECT_EQ(simd_sum(floats.data(), n, level), std::accumulate(floats.begin(), floats.end(), 0.0f));
+        }
+    }
+
+    // int sums wrap
+    std::vector<std::int32_t> big(100, std::numeric_limits<std::int32_t>::max());
+    std::uint32_t expect = 0;
+    for(std::int32_t v : big) {
+        expect += (std::uint32_t)v;
+    }
+    for(SimdLevel level : supported_levels()) {
+        EXPECT_EQ(simd_sum(big.data(), big.size(), level), (std::int32_t)expect);
+    }
+}
+
+TEST(SimdKernelsTest, FindEveryLevel) {
+    for(SimdLevel level : supported_levels()) {
+        for(int n : {0, 1, 5, 16, 33, 1000}) {
+            std::vector<std::int32_t> ints(n, 1);
+            std::vector<float> floats(n, 1.0f);
+            std::vector<double> doubles(n, 1.0);
+            EXPECT_EQ(simd_find(ints.data(), n, 2, level), (std::size_t)n);
+            for(int pos = 0; pos < n; pos += 3) {
+                ints[pos] = 2;
+                floats[pos] = -0.0f;
+                doubles[pos] = 2.0;
+                // the first match wins
+                if(pos + 1 < n) {
+                    ints[pos + 1] = 2;
+                }
+                EXPECT_EQ(simd_find(ints.data(), n, 2, level), (std::size_t)pos);
+                EXPECT_EQ(simd_find(floats.data(), n, 0.0f, level), (std::size_t)pos);
+                EXPECT_EQ(simd_find(doubles.data(), n, 2.0, level), (std::size_t)pos);
+                ints[pos] = 1;
+                if(pos + 1 < n) {
+                    ints[pos + 1] = 1;
+                }
+                floats[pos] = 1.0f;
+                doubles[pos] = 1.0;
+            }
+        }
+        // NaN compares unequal like ==
+        std::vector<double> nans(10, std::nan(""));
+        EXPECT_EQ(simd_find(nans.data(), nans.size(), std::nan(""), level), nans.size());
+    }
+}
+
+TEST(SimdKernelsTest, ParallelAlgorithmsUseKernels) {
+    EXPECT_TRUE(IsContiguousIterator<std::vector<int>::iterator>::value);
+    EXPECT_TRUE(IsContiguousIterator<const double*>::value);
+    EXPECT_FALSE(IsContiguousIterator<std::vector<bool>::iterator>::value);
+
+    std::vector<int> ints(100000);
+    std::iota(ints.begin(), ints.end(), 0);
+    EXPECT_EQ(parallel_accumulate(ints.begin(), ints.end(), 0), std::accumulate(ints.begin(), ints.end(), 0));
+    EXPECT_EQ(parallel_find(ints.begin(), ints.end(), 77777), ints.begin() + 77777);
+    EXPECT_EQ(parallel_find(ints.begin(), ints.end(), -1), ints.end());
+
+    std::vector<double> doubles(100000, 0.25);
+    EXPECT_EQ(parallel_accumulate(doubles.begin(), doubles.end(), 1.0), 25001.0);
+    EXPECT_EQ(parallel_find(doubles.data(), doubles.data() + doubles.size(), 0.5), doubles.data() + doubles.size());
+}
+
+TEST(SimdKernelsTest, Benchmark) {
+    std::vector<float> values(10000000, 1.0f);
+    values.back() = 2.0f;
+
+    auto start = std::chrono::steady_clock::now();
+    float scalar_sum = std::accumulate(values.begin(), values.end(), 0.0f);
+    auto scalar_find = std::find(values.begin(), values.end(), 2.0f);
+    auto scalar_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    float simd_sum_value = simd_sum(values.data(), values.size());
+    std::size_t simd_find_index = simd_find(values.data(), values.size(), 2.0f);
+    auto simd_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    float parallel_sum = parallel_accumulate(values.begin(), values.end(), 0.0f);
+    auto parallel_find_it = parallel_find(values.begin(), values.end(), 2.0f);
+    auto parallel_time = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(scalar_find - values.begin(), (long)simd_find_index);
+    EXPECT_EQ(parallel_find_it, scalar_find);
+    EXPECT_EQ(scalar_sum, 10000001.0f);
+    EXPECT_EQ(simd_sum_value, 10000001.0f);
+    EXPECT_EQ(parallel_sum, 10000001.0f);
+    std::cout << "sum and find over " << values.size() << " floats, level " << (int)simd_level() << ": scalar "
+        << std::chrono::duration_cast<std::chrono::microseconds>(scalar_time).count() << "us, simd "
+        << std::chrono::duration_cast<std::chrono::microseconds>(simd_time).count() << "us, parallel simd "
+        << std::chrono::duration_cast<std::chrono::microseconds>(parallel_time).count() << "us" << std::endl;
+}
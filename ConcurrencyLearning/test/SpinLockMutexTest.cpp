@@ -1,11 +1,16 @@
 #include "gtest/gtest.h"
 #include "SpinLockMutex.h"
 #include <thread>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <iostream>
 
+template<typename Mutex = SpinLockMutex>
 int two_thread_add(const int step_count, const bool use_mutex) {
 	using namespace std::literals;
 	int value = 0;
-	SpinLockMutex mutex;
+	Mutex mutex;
 	auto adder = [&value, use_mutex, &mutex, step_count]() {
 		for (int i = 0; i < step_count; i++) {
 			if (use_mutex) {
@@ -39,3 +44,66 @@ TEST(SpinLockMutexTest, TwoThreadAddDirectly) {
 	EXPECT_GE(expect, step_count);
 	EXPECT_LE(expect, step_count * 2);
 }
+
+TEST(ByteSpinLockTest, TwoThreadAddWithMutex) {
+	int step_count = 100000;
+	EXPECT_EQ(two_thread_add<ByteSpinLock>(step_count, true), step_count * 2);
+}
+
+TEST(TTASSpinLockTest, TwoThreadAddWithMutex) {
+	int step_count = 100000;
+	EXPECT_EQ(two_thread_add<TTASSpinLock>(step_count, true), step_count * 2);
+}
+
+TEST(TTASSpinLockTest, TryLock) {
+	TTASSpinLock mutex;
+	ASSERT_TRUE(mutex.try_lock());
+	EXPECT_FALSE(mutex.try_lock());
+	mutex.unlock();
+	EXPECT_TRUE(mutex.try_lock());
+	mutex.unlock();
+
+	SpinLockMutex spin;
+	ASSERT_TRUE(spin.try_lock());
+	EXPECT_FALSE(spin.try_lock());
+	spin.unlock();
+}
+
+// microseconds for num_threads threads doing steps_per_thread short
+// critical sections each on one shared lock
+template<typename Mutex>
+long long contended_add_us(int num_threads, int steps_per_thread) {
+	Mutex mutex;
+	long long value = 0;
+	std::vector<std::thread> tids;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&mutex, &value, steps_per_thread]() {
+			for (int k = 0; k < steps_per_thread; k++) {
+				std::lock_guard<Mutex> lk(mutex);
+				value++;
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	EXPECT_EQ(value, (long long)num_threads * steps_per_thread);
+	return us;
+}
+
+TEST(SpinLockMutexTest, ContentionBenchmark) {
+	int steps_per_thread = 20000;
+	int max_threads = std::max(16, 2 * (int)std::thread::hardware_concurrency());
+	for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		long long spin_us = contended_add_us<SpinLockMutex>(num_threads, steps_per_thread);
+		long long ttas_us = contended_add_us<TTASSpinLock>(num_threads, steps_per_thread);
+		long long mutex_us = contended_add_us<std::mutex>(num_threads, steps_per_thread);
+		std::cout << "threads: " << num_threads
+			<< ", SpinLockMutex: " << spin_us << "us"
+			<< ", TTASSpinLock: " << ttas_us << "us"
+			<< ", std::mutex: " << mutex_us << "us" << std::endl;
+	}
+}
@@ -5,6 +5,8 @@
 #include <thread>
 #include <future>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 void print_status(std::future_status status) {
         std::string str;
@@ -26,7 +28,9 @@ void print_status(std::future_status status) {
 };
 
 TEST(DeadLockThreadPoolTest, DeadLock) {
-    DeadLockThreadPool pool;
+    // every level but the last blocks a worker, so the depth 5 recursion
+    // needs 5 workers to finish, whatever the machine
+    DeadLockThreadPool pool(5);
 
     std::function<int(int, int)> recursive_call = [&pool, &recursive_call](int up, int v)->int {
         if(v == up)return v;
@@ -82,3 +86,57 @@ TEST(NoDeadLockThreadPoolTest, SolveDependencyProblem) {
     std::future<int> res2 = std::async(recursive_call, value, 0);
     EXPECT_TRUE(res2.get() == value);
 }
+
+TEST(ThreadPoolTest, SubmitAndNestedWait) {
+    ThreadPool pool(2);
+    EXPECT_EQ(pool.size(), 2);
+
+    std::future<int> answer = pool.submit([]() {
+        return 42;
+    });
+    pool.wait(answer);
+    EXPECT_EQ(answer.get(), 42);
+
+    // tasks wait for their subtasks without blocking a worker
+    std::function<int(int, int)> recursive_call = [&pool, &recursive_call](int up, int v)->int {
+        if(v == up)return v;
+        std::future<int> result = pool.submit(std::bind(recursive_call, up, v + 1));
+        pool.wait(result);
+        return result.get();
+    };
+    std::future<int> res = pool.submit(std::bind(recursive_call, 100, 0));
+    pool.wait(res);
+    EXPECT_EQ(res.get(), 100);
+}
+
+TEST(ThreadPoolTest, CurrentWorker) {
+    ThreadPool pool(3);
+    ThreadPool other(1);
+    EXPECT_EQ(pool.current_worker(), 0);
+    std::vector<std::future<std::pair<int, int> > > futures;
+    for(int i = 0; i < 20; i++) {
+        futures.push_back(pool.submit([&pool, &other]() {
+            return std::make_pair(pool.current_worker(), other.current_worker());
+        }));
+    }
+    for(auto&& future : futures) {
+        std::pair<int, int> workers = future.get();
+        EXPECT_GE(workers.first, 1);
+        EXPECT_LE(workers.first, 3);
+        // a worker of one pool is no worker of another
+        EXPECT_EQ(workers.second, 0);
+    }
+}
+
+TEST(ThreadPoolTest, DestructorRunsPendingTasks) {
+    std::atomic<int> count(0);
+    {
+        ThreadPool pool(1);
+        for(int i = 0; i < 100; i++) {
+            pool.submit([&count]() {
+                count++;
+            });
+        }
+    }
+    EXPECT_EQ(count.load(), 100);
+}
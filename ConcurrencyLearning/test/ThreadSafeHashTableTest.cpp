@@ -1,9 +1,15 @@
 #include "ThreadSafeHashTable.h"
+#include "SpinLockMutex.h"
+#include "RWSpinLock.h"
 #include "gtest/gtest.h"
 #include <random>
 #include <algorithm>
 #include <chrono>
 #include <map>
+#include <thread>
+#include <cmath>
+#include <atomic>
+#include <iostream>
 
 TEST(ThreadSafeHashTableTest, CRUD) {
 	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
@@ -91,3 +97,165 @@ TEST(ThreadSafeHashTableTest, CRUD) {
 		ASSERT_EQ(it->second, opt_value.value()) << "inequal at key " << it->first;
 	}
 }
+
+TEST(ThreadSafeHashTableTest, IterateAndSnapshot) {
+	ThreadSafeHashTable<int, int> hash_table(31);
+	int num_values = 1000;
+	for (int i = 0; i < num_values; i++) {
+		hash_table.insert_or_update(i, i * 2);
+	}
+
+	EXPECT_EQ(hash_table.size(), num_values);
+
+	long long sum = 0;
+	hash_table.for_each([&sum](const int&, const int& value) {
+		sum += value;
+	});
+	EXPECT_EQ(sum, (long long)num_values * (num_values - 1));
+
+	ThreadPool pool(2);
+	std::atomic<long long> parallel_sum(0);
+	hash_table.parallel_for_each([&parallel_sum](const int&, const int& value) {
+		parallel_sum += value;
+	}, SimplePartitioner(1), pool);
+	EXPECT_EQ(parallel_sum.load(), sum);
+
+	std::unordered_map<int, int> map_snapshot = hash_table.snapshot();
+	ASSERT_EQ(map_snapshot.size(), num_values);
+	for (int i = 0; i < num_values; i++) {
+		ASSERT_EQ(map_snapshot[i], i * 2);
+	}
+
+	std::vector< std::pair<int, int> > entries = hash_table.snapshot_entries();
+	ASSERT_EQ(entries.size(), num_values);
+	std::sort(entries.begin(), entries.end());
+	for (int i = 0; i < num_values; i++) {
+		ASSERT_EQ(entries[i].first, i);
+	}
+}
+
+TEST(ThreadSafeHashTableTest, ParallelForEachWithWriters) {
+	ThreadSafeHashTable<int, int> hash_table(257);
+	int num_stable = 10000;
+	for (int i = 0; i < num_stable; i++) {
+		hash_table.insert_or_update(i, 1);
+	}
+
+	// writers touch a disjoint key range while the table is scanned
+	std::atomic<bool> done(false);
+	auto writer = [&hash_table, &done, num_stable]() {
+		int key = num_stable;
+		while (!done.load()) {
+			hash_table.insert_or_update(key, 100);
+			hash_table.erase(key);
+			key = key + 1 < num_stable * 2 ? key + 1 : num_stable;
+		}
+	};
+
+	std::vector< std::thread > writer_tids;
+	for (int i = 0; i < 4; i++) {
+		writer_tids.emplace_back(writer);
+	}
+
+	for (int round = 0; round < 5; round++) {
+		std::atomic<int> stable_count(0);
+		hash_table.parallel_for_each([&stable_count, num_stable](const int& key, const int& value) {
+			if (key < num_stable) {
+				stable_count.fetch_add(value);
+			}
+		});
+		EXPECT_EQ(stable_count.load(), num_stable);
+	}
+
+	done.store(true);
+	for (auto&& tid : writer_tids) {
+		tid.join();
+	}
+	EXPECT_EQ(hash_table.size(), num_stable);
+}
+
+template<typename Mutex>
+void striped_insert_and_get(int num_stripes) {
+	ThreadSafeHashTable<int, int, std::hash<int>, Mutex> hash_table(101, std::hash<int>(), num_stripes);
+	int num_threads = 8, num_per_thread = 500;
+
+	auto worker = [&hash_table, num_per_thread](int id) {
+		for (int i = 0; i < num_per_thread; i++) {
+			int key = id * num_per_thread + i;
+			hash_table.insert_or_update(key, key + 1);
+			hash_table.get(key);
+		}
+	};
+
+	std::vector< std::thread > tids;
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back(worker, i);
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+
+	ASSERT_EQ(hash_table.size(), num_threads * num_per_thread);
+	for (int key = 0; key < num_threads * num_per_thread; key++) {
+		std::optional<int> opt_value = hash_table.get(key);
+		ASSERT_TRUE(opt_value.has_value());
+		ASSERT_EQ(opt_value.value(), key + 1);
+	}
+}
+
+TEST(ThreadSafeHashTableTest, LockStriping) {
+	ThreadSafeHashTable<int, int> default_table(1000);
+	EXPECT_GE(default_table.num_stripes(), 1);
+	EXPECT_LE(default_table.num_stripes(), 1000);
+
+	// never more stripes than buckets
+	ThreadSafeHashTable<int, int> small_table(3, std::hash<int>(), 64);
+	EXPECT_EQ(small_table.num_stripes(), 3);
+
+	striped_insert_and_get<std::shared_mutex>(1);
+	striped_insert_and_get<std::shared_mutex>(16);
+	striped_insert_and_get<SpinLockMutex>(16);
+	striped_insert_and_get<RWSpinLock>(16);
+	striped_insert_and_get< DistributedRWSpinLock<> >(16);
+}
+
+// each thread hammers its own lock, packed locks share cache lines,
+// aligned ones do not. the gap grows with the number of cores.
+template<typename LockArray>
+long long hammer_neighbour_locks(LockArray& locks, int num_threads,
+	std::shared_mutex& (*get_lock)(LockArray&, int)) {
+	int num_iterations = 200000;
+	auto start = std::chrono::steady_clock::now();
+	std::vector< std::thread > tids;
+	for (int i = 0; i < num_threads; i++) {
+		tids.emplace_back([&locks, get_lock, i, num_iterations]() {
+			std::shared_mutex& mut = get_lock(locks, i);
+			for (int k = 0; k < num_iterations; k++) {
+				mut.lock_shared();
+				mut.unlock_shared();
+			}
+		});
+	}
+	for (auto&& tid : tids) {
+		tid.join();
+	}
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(ThreadSafeHashTableTest, FalseSharingBenchmark) {
+	int num_threads = std::max(2, (int)std::thread::hardware_concurrency());
+
+	std::vector<std::shared_mutex> packed(num_threads);
+	std::vector< CacheAligned<std::shared_mutex> > aligned(num_threads);
+
+	long long packed_us = hammer_neighbour_locks<decltype(packed)>(packed, num_threads,
+		[](decltype(packed)& locks, int i) -> std::shared_mutex& { return locks[i]; });
+	long long aligned_us = hammer_neighbour_locks<decltype(aligned)>(aligned, num_threads,
+		[](decltype(aligned)& locks, int i) -> std::shared_mutex& { return locks[i].value; });
+
+	std::cout << "threads: " << num_threads
+		<< ", packed locks: " << packed_us << "us"
+		<< ", cache aligned locks: " << aligned_us << "us" << std::endl;
+	EXPECT_EQ(sizeof(CacheAligned<std::shared_mutex>) % CACHE_LINE_SIZE, 0);
+}
@@ -2,8 +2,15 @@
 #include "gtest/gtest.h"
 
 #include <vector>
-
-TEST(ThreadSafeListTest, CRUD) {
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <string>
+#include <iostream>
+
+template<typename List>
+void crud_test() {
 	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
 	std::srand(seed);
 
@@ -12,7 +19,7 @@ TEST(ThreadSafeListTest, CRUD) {
     };
 
     int list_length = 3000;
-    ThreadSafeList<int> list;
+    List list;
 
     auto inserter = [&list, &value_set](int num_insert) {
         for(int i = 0; i < num_insert; i++) {
@@ -98,3 +105,109 @@ TEST(ThreadSafeListTest, CRUD) {
         }).has_value());
     }
 }
+
+TEST(ThreadSafeListTest, CRUD) {
+    crud_test< ThreadSafeList<int> >();
+}
+
+TEST(CompactThreadSafeListTest, CRUD) {
+    crud_test< CompactThreadSafeList<int> >();
+}
+
+TEST(CompactThreadSafeListTest, UnrolledCRUD) {
+    crud_test< CompactThreadSafeList<int, 8> >();
+}
+
+TEST(CompactThreadSafeListTest, UnrolledKeepsOrderAndCounts) {
+    CompactThreadSafeList<std::string, 4> list;
+    for(int i = 0; i < 10; i++) {
+        list.push_front(std::to_string(i));
+    }
+    list.remove_if([](const std::string& data) {
+        return std::stoi(data) % 3 == 0;
+    });
+
+    std::vector<std::string> visited;
+    list.for_each([&visited](std::string& data) {
+        visited.push_back(data);
+    });
+    EXPECT_EQ(visited, std::vector<std::string>({ "8", "7", "5", "4", "2", "1" }));
+
+    std::optional<std::string> found = list.find_first_if([](const std::string& data) {
+        return data < "5";
+    });
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found.value(), "4");
+}
+
+TEST(CompactThreadSafeListTest, MemoryPerElement) {
+    // rough per element footprint, ignoring allocator headers of the plain list
+    std::size_t plain = sizeof(std::mutex) + sizeof(int) + sizeof(void*);
+    std::size_t compact = CompactThreadSafeList<int>::node_size();
+    std::size_t unrolled = CompactThreadSafeList<int, 16>::node_size() / 16;
+    std::cout << "bytes per int element, ThreadSafeList: >= " << plain
+        << ", compact: " << compact << ", unrolled x16: " << unrolled << std::endl;
+    EXPECT_LT(compact, plain);
+    EXPECT_LT(unrolled, compact);
+}
+
+TEST(LazyThreadSafeListTest, ReadersDuringRemoval) {
+    LazyThreadSafeList<int> list;
+    int list_length = 5000, num_inserters = 4;
+
+    std::vector<std::thread> inserter_tids;
+    for(int i = 0; i < num_inserters; i++) {
+        inserter_tids.emplace_back([&list, list_length, num_inserters, i]() {
+            for(int value = i; value < list_length; value += num_inserters) {
+                list.push_front(value);
+            }
+        });
+    }
+    for(auto&& tid : inserter_tids) {
+        tid.join();
+    }
+
+    long long total = 0;
+    list.for_each([&total](const int& data) {
+        total += data;
+    });
+    EXPECT_EQ(total, (long long)list_length * (list_length - 1) / 2);
+
+    // readers scan while removers delete every odd value
+    std::atomic<bool> done(false);
+    std::vector<std::thread> finder_tids, remover_tids;
+    for(int i = 0; i < 4; i++) {
+        finder_tids.emplace_back([&list, &done, list_length]() {
+            while(!done.load()) {
+                int even = (rand() % (list_length / 2)) * 2;
+                EXPECT_TRUE(list.find_first_if([even](const int& data) {
+                    return data == even;
+                }).has_value());
+            }
+        });
+    }
+    for(int i = 0; i < 4; i++) {
+        remover_tids.emplace_back([&list]() {
+            list.remove_if([](const int& data) {
+                return data % 2 == 1;
+            });
+        });
+    }
+    for(auto&& tid : remover_tids) {
+        tid.join();
+    }
+    done.store(true);
+    for(auto&& tid : finder_tids) {
+        tid.join();
+    }
+
+    int count = 0;
+    list.for_each([&count](const int& data) {
+        EXPECT_EQ(data % 2, 0);
+        count++;
+    });
+    EXPECT_EQ(count, list_length / 2);
+    EXPECT_FALSE(list.find_first_if([](const int& data) {
+        return data == 1;
+    }).has_value());
+}